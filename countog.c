@@ -2,32 +2,75 @@
 /* countog.c - prepare training and test data by counting oligonucleotides   */
 /*                                                                           */
 /* COMPILE                                                                   */
-/*   $ gcc -W -Wall -O -ansi -pedantic -Werror -lm -o countog countog.c      */
+/*   $ gcc -W -Wall -O -ansi -pedantic -Werror -pthread \                    */
+/*       -o countog countog.c -lz                                            */
+/*   SIMD kernels are chosen at run time; see -a                             */
 /*                                                                           */
 /* SYNOPSIS                                                                  */
-/*   $ countog [-c number_of_oligos] [-d] [-g genome_size] [-l label] \      */
-/*       [-o size_of_oligo] [-q min_q_score] [-r] [-s size_of_shift]  \      */
-/*       input_FASTA_or_FASTQ                                                */
+/*   $ countog [-a simd] [-b regions.bed] [-c number_of_oligos] [-d] [-e] \  */
+/*       [-g genome_size] [-j threads] [-k] [-l label] [-o size_of_oligo] \  */
+/*       [-m sketch_bytes] [-n local_or_interleave] [-p] [-q min_q_score] \  */
+/*       [-r] [-s size_of_shift] [-t number_of_data] [-w stride] \           */
+/*       [-i index_file] [-u oligos_of_block] [-y seed] [-x excluded.bed] \  */
+/*       input_FASTA_FASTQ_BAM_or_2bit ...  (- for the standard input)       */
 /*                                                                           */
 /* USAGE                                                                     */
 /*   $ countog -d -l mouse -o 6 -t 100 mm10.fa                               */
+/*   $ countog -d -e -l mouse -l rat -o 6 -t 100 mm10.fa rn6.fa              */
 /*                                                                           */
 /* DESCRIPTION                                                               */
-/*    This program reads a FASTA or FASTQ sequence file and counts           */
-/*    numbers of each specified-length oligonucleotides.                     */
+/*    This program reads a FASTA, FASTQ, BAM, or UCSC .2bit file and counts  */
+/*    numbers of each specified-length oligonucleotides.  Several inputs     */
+/*    are joined into one genome unless -e is given.  FASTA and FASTQ        */
+/*    may be compressed with gzip or bgzip (with or without .gzi).  Reads    */
+/*    of BAM, usually unaligned, are taken as FASTQ without secondary and    */
+/*    supplementary alignments.                                              */
+/*    FASTQ reads may be of any length and wrapped into several lines.       */
 /*    Normalized values, which range from 0 to 1, are printed onto the       */
 /*    standard output.                                                       */
 /*                                                                           */
 /* OPTIONS                                                                   */
+/*   -a  SIMD kernels, scalar, sse4.2, avx2, or avx512 (--simd); the best    */
+/*       one which the CPU supports by default                               */
+/*   -b  Count only the intervals of a BED file (--regions), read through    */
+/*       .fai of FASTA, and .gzi if it is bgzipped                           */
 /*   -c  Number of counting oligos for one-line data (default 100000)        */
 /*   -d  Print the header line                                               */
-/*   -g  Maximum genome size (default: 4294967296)                           */
-/*   -l  Add a label for training data                                       */
-/*   -o  Size of oligonucleotide in nt                                       */
-/*   -q  Minimum quality score (default: 16)                                 */
+/*   -e  Count each input separately, labelled by -l in order or its name    */
+/*   -g  Maximum genome size, truncated with a warning (default: no limit)   */
+/*   -i  Keep counts of oligos at checkpoints in a file (--index), made in   */
+/*       parallel unless it is for the same genome, -o and -u; a window is   */
+/*       the difference of two checkpoints and the oligos at its edges; for  */
+/*       -o up to 15, not with -m, -p, or -w                                 */
+/*   -j  Number of threads for reading a file (default: number of CPUs)      */
+/*   -k  Keep the parsed genome in input.cog and reuse it next time          */
+/*   -l  Add a label for training data, once for each input with -e          */
+/*   -m  Count approximately in a count-min sketch (--sketch) of at most     */
+/*       this many bytes, with k, m, or g, and report the error at the end;  */
+/*       up to -o 15, every oligo is printed as estimated, and above it, an  */
+/*       oligo whose cells are all taken by others is missing from the row   */
+/*   -o  Size of oligonucleotide in nt, 1 to 31; above 15, only the oligos   */
+/*       found in each row are printed as TCAG...:0.1234, with no header     */
+/*   -n  NUMA policy of the genome and counters, local or interleave         */
+/*       (--numa), and report it and the pages which are used                */
+/*   -p  Print rows while reading, without keeping the genome (pipe)         */
+/*   -q  Minimum quality score (default: 16), ignored for FASTA and .2bit    */
 /*   -r  Merge complementary oligonucleotides                                */
 /*   -s  Size of shift in bp for the next round                              */
 /*   -t  Number of one-line data (default: 20000)                            */
+/*   -u  Oligos between the checkpoints of -i (--block), each of which       */
+/*       takes 4^k counters (default: 16 x 4^k, at least 65536), so that     */
+/*       the index is about as large as the packed genome                    */
+/*   -w  Slide the window of -c oligos by this many oligos for each row      */
+/*       (--slide), adding those entering and removing those leaving; for    */
+/*       -o up to 15, not with -m or -p                                      */
+/*   -x  Do not count oligos in the intervals of a BED file (--exclude),     */
+/*       by the names of FASTA, .2bit, or -b; not with -p                    */
+/*   -y  Start each row at a random oligo from this seed (--random), with    */
+/*       or without -i; for -o up to 15, not with -m, -p, or -w              */
+/*                                                                           */
+/*   The genome and counters are mapped on huge pages (hugetlbfs) if they    */
+/*   are reserved, otherwise on transparent huge pages if they are enabled.  */
 /*                                                                           */
 /* AUTHOR                                                                    */
 /*   Coded by Kohji OKAMURA, Ph.D.                                           */
@@ -39,190 +82,3257 @@
 /*   2017-09-18  Output normalized counts                                    */
 /*   2017-09-19  Support option -l, label for training data                  */
 /*   2017-09-29  Released at GitHub                                          */
+/*   2026-10-16  Store the genome in 2 bits per base with a list of gaps     */
+/*   2026-10-16  Parse a memory-mapped input file without copying lines      */
+/*   2026-10-16  Pipe mode which prints rows while reading the input         */
+/*   2026-10-16  Count oligos with a rolling index instead of pow()          */
+/*   2026-10-16  Encode 32 bases at once with SSE4.2 or AVX2                 */
+/*   2026-10-16  Parse slices of a mapped file in parallel threads           */
+/*   2026-10-16  Read UCSC .2bit files directly                              */
+/*   2026-10-16  Cache the parsed genome next to the input file (-k)         */
+/*   2026-10-16  Allocate the genome for the input and grow it as needed     */
+/*   2026-10-16  Decompress gzip input in another thread                     */
+/*   2026-10-16  Decompress BGZF blocks in parallel threads                  */
+/*   2026-10-16  Read many inputs and - for stdin, joined or each (-e)       */
+/*   2026-10-16  Parse wrapped, CRLF and long FASTQ reads, masking -q in SIMD*/
+/*   2026-10-16  Read unaligned BAM through the BGZF threads                 */
+/*   2026-10-16  Count only intervals of a BED file through .fai (--regions) */
+/*   2026-10-16  Exclude intervals of a BED file from counting (--exclude)   */
+/*   2026-10-16  Huge pages and NUMA policy (-n) for the genome and counters */
+/*   2026-10-16  Choose SIMD kernels at run time by cpuid (-a)               */
+/*   2026-10-16  Generate counting kernels for each size of oligo            */
+/*   2026-10-16  Count oligos up to 31 nt in a hash table, printed sparse    */
+/*   2026-10-16  Count in a count-min sketch within a memory budget (-m)     */
+/*   2026-10-16  Count large oligos through radix partitions by the cache    */
+/*   2026-10-16  Reset and scale only the counters touched in a row          */
+/*   2026-10-16  Slide windows by a stride, counting only the change (-w)    */
+/*   2026-10-16  Index counts at checkpoints for any window (-i, -y)         */
 /*                                                                           */
 /* MEMORANDOM                                                                */
-/*   Next error code: Error 9, Error 13, Error 14, ...                       */
+/*   Next error code: Error 34, Error 35, ...                                */
 /*                                                                           */
 
-#include <math.h>
+#define _GNU_SOURCE	/* mmap(), madvise() and posix_fadvise() with -ansi */
+
 #include <stdio.h>
 #include <ctype.h>
+#include <fcntl.h>
+#include <getopt.h>
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <assert.h>
+#include <pthread.h>
+#include <zlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define X86_KERNELS	/* compiled for each instruction set, see -a */
+#define TARGET(isa) __attribute__((target(isa)))
+#endif
 
 #define OLIGO 8
-#define SIZE_GENOME 4294967296L	/* 2^32, more than 4 billion (bases) */
+#define MAX_OLIGO 15	/* 4^15 counters in int, see KERNELS() */
+#define MAX_LONG_OLIGO 31	/* codes in unsigned long, count_hashed() */
+#define NO_OLIGO (~0UL)	/* an empty slot of the hash table */
+#define GOLDEN 0x9E3779B97F4A7C15UL	/* 2^64 / golden ratio, for hashing */
+#define SECOND 0xC2B2AE3D27D4EB4FUL	/* another odd multiplier */
+#define SKETCH_DEPTH 4	/* rows of the count-min sketch */
+#define MIN_SKETCH 1024	/* counters in a row at least */
+#define CACHE_BITS 16	/* counters of a partition, 256 KiB in L2 */
+#define SIZE_CACHE 33554432L	/* the last-level cache, unless sysconf() */
+#define MAX_FANOUT 10	/* bits for partitions, within the TLB */
+#define SIZE_GENOME 0L	/* no limit; the genome grows as needed */
+#define SIZE_GAPS 1024	/* initial number of runs in the gap list */
 #define SIZE_LINE_CHARS 1024
+#define SIZE_BLOCK 1048576	/* bytes read at once from a stream */
+#define SIZE_WORD 32	/* bases encoded at once by encode_bases() */
+#define SIZE_RING 8	/* decompressed blocks waiting for the parser */
+#define SIZE_BGZF 65536	/* the largest BGZF block */
+#define BGZF_BATCH (SIZE_BLOCK / SIZE_BGZF)	/* blocks per thread */
+#define GZI_SUFFIX ".gzi"
+#define FAI_SUFFIX ".fai"
+#define SIZE_PAGE 4096L
+#define SIZE_HUGE 2097152L	/* a huge page of x86-64 */
+#define MAX_NODES 1024	/* NUMA nodes in the mask of mbind() */
+#define SIZE_FIELD 7	/* 0.1234 and a tab in a row */
 #define SIZE_COUNTING 100000
 #define SIZE_DATA 20000
 #define SIZE_SHIFT 20000
 #define NUCLEOTIDES 4
 #define DEFAULT_MIN_QSCORE 16
 #define CODE_TO_SCORE (int)(-33)
+#define BAM_MAGIC "BAM\1"
+#define BAM_SKIPPED 0x900	/* secondary and supplementary alignments */
+#define TWOBIT_SIGNATURE 0x1A412743
+#define CACHE_MAGIC "countog1"	/* the first eight bytes of a cache */
+#define CACHE_SUFFIX ".cog"
+#define INDEX_MAGIC "countogx"	/* the first eight bytes of an index */
+#define INDEX_BLOCK 65536L	/* oligos between checkpoints at least */
+#define INDEX_RATIO 16L	/* oligos between checkpoints per counter */
+#define SIZE_INDEX 67108864L	/* a larger index than this and the genome */
+#define GET_BASE(p) ((genome[(p) >> 2] >> (((p) & 3) << 1)) & 3)
+	/* 2-bit code of a base at position p: t = 0, c = 1, a = 2, g = 3 */
+
+struct region
+{	/* an interval of BED */
+  char *name;
+  long int start, end;	/* [start, end) */
+};
+
+struct fai
+{	/* a sequence in .fai of FASTA */
+  char *name;
+  long int length, offset, linebases, linewidth;
+};
+
+struct record
+{	/* a sequence in the genome, named for -x */
+  char *name;
+  long int start, end;	/* [start, end) in the genome */
+  long int offset;	/* the position of start in the sequence */
+};
+
+struct gap
+{	/* a run of separators, ns and masked bases which are not counted */
+  long int start, end;	/* [start, end) */
+};
+
+struct store
+{	/* where a parser appends bases, or a slice of the genome */
+  long int gsize, gnsize;	/* as the global ones */
+  struct gap *gaps;
+  long int num_gaps, size_gaps;
+  long int head, tail;	/* bytes shared with the neighbouring slices */
+  int head_bits, tail_bits;	/* to be merged after all threads finish */
+  int dry;	/* only count the bases */
+  int full;	/* reached the maximum genome size */
+  char *wrap;	/* sequence and quality of a wrapped FASTQ record */
+  long int size_wrap;
+  int in_records;	/* past the BAM header */
+  struct record *records;	/* names of sequences only with -x */
+  long int num_records, size_records;
+};
+
+struct cache
+{	/* the header of a cache file, followed by the gaps and the genome */
+  char magic[8];
+  long int size, mtime, mtime_nsec;	/* of the source file */
+  unsigned long checksum;
+  long int gsize, gnsize, num_gaps;
+  long int fastq, qscore;	/* -q matters only for FASTQ and BAM */
+};
+
+struct index
+{	/* the header of an index file, followed by the checkpoints */
+  char magic[8];
+  unsigned long checksum;	/* of the genome and the gaps */
+  long int gnsize, oligo, block, num_checks;
+};
+
+struct run
+{	/* oligos without gaps from start, the first-th oligo first */
+  long int start, first;
+};
+
+struct blocks
+{	/* blocks or columns of the index for a thread */
+  long int from, to;
+};
+
+struct inflater
+{	/* a thread which decompresses gzip into a ring of blocks */
+  FILE *fp;	/* either a stream */
+  const unsigned char *map;	/* or a mapped file */
+  long int length;
+  pthread_t tid;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;	/* a block is filled or emptied */
+  char *block[SIZE_RING];
+  long int filled[SIZE_RING], offset;	/* offset in the first block */
+  int first, count, eof, stop, error;
+};
+
+struct bgzf
+{	/* threads which decompress batches of BGZF blocks into a ring */
+  const unsigned char *map;
+  long int length, num_blocks;
+  long int *coffset, *uoffset;	/* of each block, and of the end */
+  pthread_mutex_t lock;
+  pthread_cond_t cond;	/* a batch is filled or emptied */
+  char *slot[SIZE_RING];
+  long int filled[SIZE_RING], ready[SIZE_RING];	/* which batch is there */
+  long int next, batch, offset;	/* for the threads and for the parser */
+  int stop, error;
+};
+
+struct slice
+{	/* a range of the input parsed by a thread */
+  const char *buf;
+  long int length, used;
+  struct store st;
+};
+
+struct hashed
+{	/* a slot of the hash table for oligos longer than MAX_OLIGO */
+  unsigned long code;	/* 2 bits for each base, the first one lowest */
+  int count;
+};
+
+struct sketch
+{	/* count-min sketch with conservative update, for -m */
+  unsigned int *cells;	/* SKETCH_DEPTH rows of width */
+  long int width, listed;	/* oligos new to the sketch, in table */
+  long int used, cleared;	/* nonzero cells and rows, for the load */
+  int shift;
+};
+
+struct kernel
+{	/* functions for one size of oligo, see KERNELS() */
+  long int (*count)(long int, long int);	/* oligos from a position */
+  long int (*buffer)(long int, long int);	/* to codes, counted later */
+  int (*complement)(int);	/* the reverse complement of an index */
+  char *(*spell)(int, char *);	/* the bases of an index */
+};
+
+int *counter, *complementary = NULL, *scaled;	/* scaled for printing */
+char *row = NULL;
+int *touched = NULL,	/* counters which are not zero, see reset_counter() */
+    *ring = NULL,	/* the oligos of the window in order, for -w */
+    *leaving = NULL,	/* those which left it for the row */
+    *tally = NULL;	/* oligos for each count, for the maximum */
+unsigned int *codes = NULL,	/* oligos of a row for partition_codes() */
+             *sorted = NULL;	/* and them in partitions */
+struct kernel kernel;	/* for the size of oligo */
+struct hashed *table = NULL;	/* open addressing with linear probing */
+struct sketch sketch;	/* only with -m */
+unsigned long seed      = 0,	/* the state of next_random() for -y */
+              pipe_idx  = 0,	/* the last oligo read in the pipe mode */
+              pipe_rev  = 0,	/* its reverse complement for -r */
+              oligo_mask = 0;	/* 2 bits for each base of an oligo */
+unsigned char *genome = NULL;	/* four bases per byte, see GET_BASE() */
+char *cache_map = NULL;	/* the genome and the gaps may be in a cache */
+char *index_map = NULL;	/* the counts at checkpoints may be in a file */
+unsigned int *prefix = NULL;	/* counts of oligos before each checkpoint, */
+	/* modulo 2^32, as their differences are what counts */
+struct run *runs = NULL;	/* with the end as a sentinel, for -i and -y */
+struct gap *gaps;	/* sorted and never adjacent to each other */
+struct region *regions = NULL,	/* only these are read with -b */
+              *excludes = NULL;	/* these are not counted with -x */
+
+long int size_genome    = SIZE_GENOME,
+         gsize          = 0,	/* exclude inserted ns */
+         gnsize         = 0,	/* include inserted ns */
+         gpos           = 0,	/* current position in the genome */
+         num_gaps       = 0,
+         gap_cursor     = 0,	/* the first gap which may cover gpos */
+         cache_length   = 0,
+         size_packed    = 0,	/* bytes allocated for the genome */
+         rows           = 0,	/* rows printed in the pipe mode */
+         num_regions    = 0,
+         num_excludes   = 0,
+         num_nodes      = 0,	/* online NUMA nodes */
+         size_regions   = 0,	/* bases in the regions */
+         size_hash      = 0,	/* slots, a power of two */
+         size_sketch    = 0,	/* bytes of the sketch by -m */
+         num_codes      = 0,
+         num_touched    = 0,	/* more than -c: lost, zero them all */
+         ring_head      = 0,	/* the oldest oligo once it is full */
+         ring_size      = 0,
+         num_runs       = 0,
+         num_oligos     = 0,	/* oligos which can be counted */
+         size_block     = 0,	/* oligos between checkpoints, by -u */
+         num_checks     = 0,	/* checkpoints at 0, size_block, ... */
+         index_length   = 0;
+int      size_oligo     = 1,
+         size_counting  = SIZE_COUNTING,
+         oligo          = OLIGO,
+         size_data      = SIZE_DATA,
+         size_shift     = SIZE_SHIFT,
+         minimum_qscore = DEFAULT_MIN_QSCORE,
+         threads        = 0,	/* 0: number of CPUs */
+         hash_shift     = 64,	/* the highest bits of a product for a slot */
+         fanout         = 0,	/* partitions by the highest bits, in bits */
+         slide          = 0,	/* oligos for the next window, by -w */
+         window_max     = 0,	/* the maximum count in the window */
+         scaled_max     = 0,	/* that when scaled was updated */
+         pipe_bases     = 0,	/* successive bases up to oligo */
+         pipe_oligos    = 0,	/* oligos counted for the current row */
+         pages_used     = 0,	/* 1: hugetlbfs, 2: transparent, 4: small */
+         numa_failed    = 0;
+char     *data_label    = NULL;
+short int fastq  = -1,	/* 0: FASTA, 1: FASTQ, 2: BAM */
+          piped  = 0,	/* count oligos while reading */
+          cached = 0,	/* keep the genome in a cache file */
+          reduce = 0,	/* for complementary oligos */
+          header = 0,	/* print the header line */
+          label  = 0,	/* label for training data */
+          each   = 0,	/* count each input separately */
+          hashed = 0,	/* oligos longer than MAX_OLIGO in the table */
+          numa   = 0;	/* 0: by the kernel, 1: local, 2: interleave */
+
+
+int print_counts(char *);
+int reset_counter(void);
+
+
+unsigned int sketch_cells(unsigned long code, unsigned int **cells)
+{	/* the cells of an oligo in each row by double hashing, and the */
+	/* smallest count of them, which is the estimate                */
+  unsigned long h = code * GOLDEN, step = (code * SECOND) | 1;
+  unsigned int min = ~0U;
+  int r;
+
+  for (r = 0; r < SKETCH_DEPTH; r++, h += step)
+  {
+    cells[r] = sketch.cells + r * sketch.width + (h >> sketch.shift);
+    if (*cells[r] < min) { min = *cells[r]; }
+  }
+  return min;
+}
+
+
+void sketch_oligo(unsigned long code, int count)
+{	/* conservative update: only the cells at the estimate are raised */
+  unsigned int *cells[SKETCH_DEPTH], min;
+  int r;
+
+  if ((min = sketch_cells(code, cells)) == 0)	/* surely new in the row, */
+  { table[sketch.listed++].code = code; }	/* otherwise taken as seen */
+  for (r = 0; r < SKETCH_DEPTH; r++)
+  { if (*cells[r] < min + count) { *cells[r] = min + count; } }
+}
+
+
+void hash_oligo(unsigned long code, unsigned long rev)
+{	/* count an oligo, which is merged with its complement for -r; */
+	/* a palindrome counts twice, as both strands in print_counts() */
+  unsigned long slot;
+  int count = 1;
+
+  if (reduce != 0 && rev <= code) { count += (rev == code); code = rev; }
+  if (sketch.cells != NULL) { sketch_oligo(code, count); return; }
+  slot = (code * GOLDEN) >> hash_shift;
+  while (table[slot].code != code && table[slot].code != NO_OLIGO)
+  { slot = (slot + 1) & (unsigned long)(size_hash - 1); }
+  table[slot].code = code;
+  table[slot].count += count;
+}
+
+
+int pipe_base(int n)
+{	/* count the oligo which ends with a base, in the pipe mode */
+  pipe_idx = (pipe_idx >> 2) | ((unsigned long)n << ((oligo - 1) << 1));
+  pipe_rev = ((pipe_rev << 2) | (unsigned long)(n ^ 2)) & oligo_mask;
+  if (pipe_bases < oligo && ++pipe_bases < oligo) { return 0; }
+  if (hashed != 0) { hash_oligo(pipe_idx, pipe_rev); }
+  else if (counter[pipe_idx]++ == 0)	/* rows beyond -t are not reset */
+  {
+    if (num_touched < size_counting) { touched[num_touched] = (int)pipe_idx; }
+    num_touched++;
+  }
+  if (++pipe_oligos == size_counting && rows < size_data)
+  {
+    print_counts(data_label);
+    fflush(stdout);	/* the rows appear immediately */
+    reset_counter();
+    pipe_oligos = 0;
+    rows++;
+  }
+  return 1;
+}
+
+
+int put_gap(struct store *st, long int length)
+{	/* append separators, ns or masked bases */
+  if (piped != 0) { pipe_bases = 0; }
+  if (piped != 0 || st->dry != 0) { st->gnsize += length; return (int)length; }
+  if (st->num_gaps > 0 && st->gaps[st->num_gaps - 1].end == st->gnsize)
+  { st->gaps[st->num_gaps - 1].end += length; }
+  else
+  {
+    if (st->num_gaps == st->size_gaps)
+    {
+      st->size_gaps = (st->size_gaps == 0) ? SIZE_GAPS : st->size_gaps * 2;
+      st->gaps = (struct gap *)realloc(st->gaps,
+                                       sizeof(struct gap) * st->size_gaps);
+      if (st->gaps == NULL)
+      {
+        fprintf(stderr, "Error 9: realloc for gaps\n");
+        exit(EXIT_FAILURE);
+      }
+    }
+    st->gaps[st->num_gaps].start = st->gnsize;
+    st->gaps[st->num_gaps].end   = st->gnsize + length;
+    st->num_gaps++;
+  }
+  st->gnsize += length;
+  return (int)length;
+}
+
+
+int put_record(struct store *st, const char *name, const char *end,
+               long int offset)
+{	/* a sequence starts here, named by the first word of name */
+  struct record *tmp;
+  long int length;
+
+  if (num_excludes == 0 || piped != 0 || st->dry != 0) { return 0; }
+  for (length = 0; name + length < end; length++)
+  { if (isspace((unsigned char)name[length]) != 0) { break; } }
+  if (st->num_records == st->size_records)
+  {
+    st->size_records = (st->size_records == 0) ? SIZE_GAPS
+                                               : st->size_records * 2;
+    tmp = (struct record *)realloc(st->records,
+                                   sizeof(struct record) * st->size_records);
+    if (tmp == NULL)
+    { fprintf(stderr, "Error 9: realloc for records\n"); exit(EXIT_FAILURE); }
+    st->records = tmp;
+  }
+  if ((st->records[st->num_records].name = (char *)malloc(length + 1)) == NULL)
+  { fprintf(stderr, "Error 9: malloc for records\n"); exit(EXIT_FAILURE); }
+  memcpy(st->records[st->num_records].name, name, length);
+  st->records[st->num_records].name[length] = '\0';
+  st->records[st->num_records].start  = st->gnsize;
+  st->records[st->num_records].offset = offset;
+  st->num_records++;
+  return 1;
+}
+
+
+long int page_size(long int size)
+{	/* a mapping is rounded up to huge pages unless it is small */
+  long int unit = (size >= SIZE_HUGE) ? SIZE_HUGE : SIZE_PAGE;
+
+  return (size + unit - 1) / unit * unit;
+}
+
+
+int thp_enabled(void)
+{	/* whether transparent huge pages are not [never] */
+  static int enabled = -1;
+  char line[SIZE_LINE_CHARS];
+  FILE *fp;
+
+  if (enabled != -1) { return enabled; }
+  enabled = 0;
+  if ((fp = fopen("/sys/kernel/mm/transparent_hugepage/enabled", "r")) != NULL)
+  {
+    if (fgets(line, sizeof(line), fp) != NULL)
+    { enabled = (strstr(line, "[never]") == NULL); }
+    fclose(fp);
+  }
+  return enabled;
+}
+
+
+int place_pages(void *p, long int size)
+{	/* the NUMA policy of -n, before the pages are touched */
+  static unsigned long mask[MAX_NODES / (8 * sizeof(unsigned long))];
+  FILE *fp;
+  int from, to, c;
+
+  if (numa == 0) { return 0; }
+  if (num_nodes == 0)	/* online nodes such as 0-3,5 */
+  {
+    if ((fp = fopen("/sys/devices/system/node/online", "r")) != NULL)
+    {
+      while (fscanf(fp, "%d", &from) == 1)
+      {
+        to = from;
+        if ((c = fgetc(fp)) == '-' && fscanf(fp, "%d", &to) == 1)
+        { c = fgetc(fp); }
+        for (; from <= to && from < MAX_NODES; from++, num_nodes++)
+        {
+          mask[from / (8 * sizeof(unsigned long))] |=
+            1UL << (from % (8 * sizeof(unsigned long)));
+        }
+        if (c != ',') { break; }
+      }
+      fclose(fp);
+    }
+    if (num_nodes == 0) { mask[0] = 1; num_nodes = 1; }
+  }
+  if (syscall(SYS_mbind, p, (unsigned long)size,
+              (numa == 2) ? MPOL_INTERLEAVE : MPOL_LOCAL,
+              (numa == 2) ? mask : NULL,
+              (numa == 2) ? (unsigned long)MAX_NODES + 1 : 0UL, 0U) != 0)
+  { numa_failed = 1; return 0; }
+  return 1;
+}
+
+
+void *get_pages(long int size)
+{	/* zeroed memory on huge pages if possible; pages are not touched */
+  void *p = MAP_FAILED;
+
+  size = page_size(size);
+  if (size >= SIZE_HUGE)
+  {
+    p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED) { pages_used |= 1; }
+  }
+  if (p == MAP_FAILED)	/* no huge pages are reserved */
+  {
+    p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) { return NULL; }
+    if (size >= SIZE_HUGE && thp_enabled() != 0 &&
+        madvise(p, size, MADV_HUGEPAGE) == 0)
+    { pages_used |= 2; }
+    else { pages_used |= 4; }
+  }
+  place_pages(p, size);
+  return p;
+}
+
+
+void *resize_pages(void *p, long int old, long int size)
+{	/* grow or shrink a mapping, moving it if needed */
+  void *q;
+
+  old  = page_size(old);
+  size = page_size(size);
+  if (size == old) { return p; }
+  q = mremap(p, old, size, MREMAP_MAYMOVE);
+  if (q == MAP_FAILED)
+  {
+    if (size < old) { return p; }	/* keep the rest */
+    if ((q = get_pages(size)) == NULL) { return NULL; }
+    memcpy(q, p, old);
+    munmap(p, old);
+    return q;
+  }
+  if (size > old && size >= SIZE_HUGE && thp_enabled() != 0 &&
+      madvise(q, size, MADV_HUGEPAGE) == 0)	/* it may have been small */
+  { pages_used |= 2; }
+  return q;
+}
+
+
+int put_pages(void *p, long int size)
+{
+  if (p == NULL) { return 0; }
+  return munmap(p, page_size(size));
+}
+
+
+int report_pages(void)
+{	/* which pages and which NUMA policy took effect, for -n */
+  char pages[SIZE_LINE_CHARS] = ", none";
+
+  if ((pages_used & 1) != 0) { strcat(pages, ", hugetlbfs pages"); }
+  if ((pages_used & 2) != 0) { strcat(pages, ", transparent huge pages"); }
+  if ((pages_used & 4) != 0) { strcat(pages, ", small pages"); }
+  fprintf(stderr, "Memory: %s; NUMA %s", pages + ((pages_used != 0) ? 8 : 2),
+          (numa_failed != 0) ? "by the kernel, as mbind() failed" :
+          (numa == 2) ? "interleave" : "local");
+  if (numa_failed == 0 && numa == 2)
+  { fprintf(stderr, " on %ld node%s", num_nodes, (num_nodes > 1) ? "s" : ""); }
+  fputc('\n', stderr);
+  return pages_used;
+}
+
+
+long int parse_size(const char *s)
+{	/* bytes with k, m, or g */
+  char *end;
+  long int size = strtol(s, &end, 10);
+
+  switch (*end)
+  {
+    case 'g': case 'G': size <<= 10;	/* FALLTHROUGH */
+    case 'm': case 'M': size <<= 10;	/* FALLTHROUGH */
+    case 'k': case 'K': size <<= 10;
+  }
+  return size;
+}
+
+
+int report_sketch(void)
+{	/* the load of the sketch when it is cleared, and the error bounds */
+  double load = 0.0, collide = 1.0, fail = 1.0;
+  int r;
+
+  if (sketch.cleared > 0)
+  {
+    load = (double)sketch.used /
+           ((double)sketch.cleared * SKETCH_DEPTH * sketch.width);
+  }
+  for (r = 0; r < SKETCH_DEPTH; r++) { collide *= load; fail /= 2.718281828; }
+  fprintf(stderr, "Sketch: %d x %ld counters (%ld bytes), load %.4f in "
+          "%ld rows; an oligo is taken as seen or overestimated at p < %.3g, "
+          "by no more than %.2f with p > %.4f\n", SKETCH_DEPTH, sketch.width,
+          (long int)sizeof(unsigned int) * SKETCH_DEPTH * sketch.width, load,
+          sketch.cleared, collide, 2.718281828 * size_counting / sketch.width,
+          1.0 - fail);
+  return (int)sketch.cleared;
+}
+
+
+int reserve_genome(long int positions)
+{	/* make room for more bases; another thread never needs this */
+  unsigned char *tmp;
+  long int size = positions / 4 + 16;
+
+  if (size <= size_packed) { return 0; }
+  if (genome == NULL)	/* pages are not touched until they are used */
+  { tmp = (unsigned char *)get_pages(size); }
+  else
+  {
+    if (size < size_packed * 2) { size = size_packed * 2; }
+    tmp = (unsigned char *)resize_pages(genome, size_packed, size);
+  }
+	/* char genome[size_genome]; does not work. */
+  if (tmp == NULL)
+  {
+    fprintf(stderr, "Error 2: allocation of %ld bytes for the genome\n", size);
+    exit(EXIT_FAILURE);
+  }
+  genome = tmp;
+  size_packed = size;
+  return 1;
+}
+
+
+int genome_full(struct store *st, long int more)
+{	/* whether -g stops the parser from appending more positions */
+  if (piped != 0 || size_genome == 0 || st->gnsize + more <= size_genome - 1)
+  { return 0; }
+  st->full = 1;
+  return 1;
+}
+
+
+int put_bits(struct store *st, long int i, int bits)
+{	/* bytes shared with another thread are merged later */
+  if (i == st->head)      { st->head_bits |= bits; }
+  else if (i == st->tail) { st->tail_bits |= bits; }
+  else                    { genome[i] |= (unsigned char)bits; }
+  return bits;
+}
+
+
+int put_code(struct store *st, int n)
+{	/* append a base by its 2-bit code */
+  if (piped != 0) { st->gnsize++; return pipe_base(n); }
+  if (st->dry == 0)
+  {
+    if ((st->gnsize >> 2) + 9 >= size_packed)
+    { reserve_genome(st->gnsize + 1); }
+    put_bits(st, st->gnsize >> 2, n << ((st->gnsize & 3) << 1));
+  }
+  st->gnsize++;
+  return 1;
+}
+
+
+int put_base(struct store *st, int c)
+{	/* append a base; other than T, C, A, and G are not counted */
+  switch (c)
+  {
+    case 'T': case 't': return put_code(st, 0);
+    case 'C': case 'c': return put_code(st, 1);
+    case 'A': case 'a': return put_code(st, 2);
+    case 'G': case 'g': return put_code(st, 3);
+    default:            return put_gap(st, 1L);
+  }
+}
+
+
+int put_word(struct store *st, unsigned long word, int number)
+{	/* append bases packed as in the genome, T, C, A, or G only */
+  int i, shift = (int)(st->gnsize & 3) << 1;
+  long int p = st->gnsize >> 2;	/* the bases may straddle nine bytes */
+
+  if (piped != 0)
+  {
+    for (i = 0; i < number; i++, word >>= 2)
+    { st->gnsize++; pipe_base((int)(word & 3)); }
+    return number;
+  }
+  if (st->dry == 0)
+  {
+    if (p + 9 >= size_packed) { reserve_genome(st->gnsize + number); }
+    for (i = 0; i < 8; i++)
+    { put_bits(st, p + i, (int)(((word << shift) >> (i << 3)) & 0xFF)); }
+    if (shift != 0) { put_bits(st, p + 8, (int)(word >> (64 - shift))); }
+  }
+  st->gnsize += number;
+  return number;
+}
+
+
+unsigned long encode_scalar(const char *p, unsigned int *invalid)
+{	/* 2-bit codes of SIZE_WORD characters packed as in the genome, */
+	/* and a bit mask of the characters other than T, C, A, and G    */
+	/* in any case                                                   */
+  unsigned long word = 0, n;
+  int i, c;
+
+  *invalid = 0;
+  for (i = 0; i < SIZE_WORD; i++)
+  {	/* bits 1-2 of A, C, G, and T are 0, 1, 3, and 2 in both cases */
+    c = (unsigned char)p[i];
+    n = (unsigned long)((c >> 1) & 3);
+    n ^= (~n & 1) << 1;	/* t = 0, c = 1, a = 2, g = 3 */
+    if ("tcag"[n] != (c | 0x20)) { *invalid |= 1U << i; }
+    word |= n << (i << 1);
+  }
+  return word;
+}
+
+
+#ifdef X86_KERNELS
+TARGET("sse4.2")
+unsigned long encode_sse42(const char *p, unsigned int *invalid)
+{	/* as encode_scalar(), 16 characters at once */
+  __m128i c, lo, valid, codes;
+  const __m128i nibble = _mm_set1_epi8(0x0F), lower = _mm_set1_epi8(0x20),
+    chars = _mm_setr_epi8(0, 'a', 0, 'c', 't', 0, 0, 'g',
+                          0, 0, 0, 0, 0, 0, 0, 0),
+    table = _mm_setr_epi8(0, 2, 0, 1, 0, 0, 0, 3, 0, 0, 0, 0, 0, 0, 0, 0),
+    pack  = _mm_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1,
+                          -1, -1, -1, -1, -1, -1, -1, -1);
+  unsigned long word = 0;
+  int i;
+
+  *invalid = 0;
+  for (i = 0; i < SIZE_WORD; i += 16)
+  {
+    c = _mm_loadu_si128((const __m128i *)(p + i));
+    lo = _mm_and_si128(c, nibble);	/* A, C, G, and T differ in it */
+    valid = _mm_cmpeq_epi8(_mm_shuffle_epi8(chars, lo),
+                           _mm_or_si128(c, lower));
+    *invalid |= (~(unsigned int)_mm_movemask_epi8(valid) & 0xFFFF) << i;
+    codes = _mm_shuffle_epi8(table, lo);	/* four codes into each byte */
+    codes = _mm_maddubs_epi16(codes, _mm_set1_epi16(0x0401));
+    codes = _mm_madd_epi16(codes, _mm_set1_epi32(0x00100001));
+    codes = _mm_shuffle_epi8(codes, pack);
+    word |= (unsigned long)(unsigned int)_mm_cvtsi128_si32(codes) << (i << 1);
+  }
+  return word;
+}
+
+
+TARGET("avx2") unsigned long encode_avx2(const char *p, unsigned int *invalid)
+{	/* as encode_scalar(), 32 characters at once */
+  __m256i c, lo, valid, codes;
+  const __m256i nibble = _mm256_set1_epi8(0x0F),
+    lower = _mm256_set1_epi8(0x20),
+    chars = _mm256_setr_epi8(0, 'a', 0, 'c', 't', 0, 0, 'g', 0, 0, 0, 0,
+                             0, 0, 0, 0, 0, 'a', 0, 'c', 't', 0, 0, 'g',
+                             0, 0, 0, 0, 0, 0, 0, 0),
+    table = _mm256_setr_epi8(0, 2, 0, 1, 0, 0, 0, 3, 0, 0, 0, 0, 0, 0, 0, 0,
+                             0, 2, 0, 1, 0, 0, 0, 3, 0, 0, 0, 0, 0, 0, 0, 0);
+
+  c = _mm256_loadu_si256((const __m256i *)p);
+  lo = _mm256_and_si256(c, nibble);	/* A, C, G, and T differ in it */
+  valid = _mm256_cmpeq_epi8(_mm256_shuffle_epi8(chars, lo),
+                            _mm256_or_si256(c, lower));
+  *invalid = ~(unsigned int)_mm256_movemask_epi8(valid);
+  codes = _mm256_shuffle_epi8(table, lo);	/* four codes into each byte */
+  codes = _mm256_maddubs_epi16(codes, _mm256_set1_epi16(0x0401));
+  codes = _mm256_madd_epi16(codes, _mm256_set1_epi32(0x00100001));
+  codes = _mm256_shuffle_epi8(codes,
+    _mm256_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                     -1, 0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                     -1, -1));
+  codes = _mm256_permutevar8x32_epi32(codes,
+    _mm256_setr_epi32(0, 4, 1, 1, 1, 1, 1, 1));
+  return (unsigned long)_mm_cvtsi128_si64(_mm256_castsi256_si128(codes));
+}
+
+
+TARGET("avx512f,avx512bw,avx512vl")
+unsigned long encode_avx512(const char *p, unsigned int *invalid)
+{	/* as encode_avx2(), with a mask register and a narrowing move */
+  __m256i c, lo, codes;
+  const __m256i nibble = _mm256_set1_epi8(0x0F),
+    lower = _mm256_set1_epi8(0x20),
+    chars = _mm256_setr_epi8(0, 'a', 0, 'c', 't', 0, 0, 'g', 0, 0, 0, 0,
+                             0, 0, 0, 0, 0, 'a', 0, 'c', 't', 0, 0, 'g',
+                             0, 0, 0, 0, 0, 0, 0, 0),
+    table = _mm256_setr_epi8(0, 2, 0, 1, 0, 0, 0, 3, 0, 0, 0, 0, 0, 0, 0, 0,
+                             0, 2, 0, 1, 0, 0, 0, 3, 0, 0, 0, 0, 0, 0, 0, 0);
+
+  c = _mm256_loadu_si256((const __m256i *)p);
+  lo = _mm256_and_si256(c, nibble);
+  *invalid = (unsigned int)
+    _mm256_cmpneq_epi8_mask(_mm256_shuffle_epi8(chars, lo),
+                            _mm256_or_si256(c, lower));
+  codes = _mm256_shuffle_epi8(table, lo);
+  codes = _mm256_maddubs_epi16(codes, _mm256_set1_epi16(0x0401));
+  codes = _mm256_madd_epi16(codes, _mm256_set1_epi32(0x00100001));
+  return (unsigned long)_mm_cvtsi128_si64(_mm256_cvtepi32_epi8(codes));
+}
+#endif
+
+
+unsigned long (*encode_bases)(const char *, unsigned int *) = encode_scalar;
+
+
+unsigned long twobit_int(const unsigned char *p, int size, int swap)
+{	/* an integer in the byte order of the .2bit file */
+  unsigned long v = 0;
+  int i;
+
+  for (i = 0; i < size; i++)
+  { v |= (unsigned long)p[(swap != 0) ? size - 1 - i : i] << (i << 3); }
+  return v;
+}
+
+
+unsigned int quality_scalar(const char *q, int below)
+{	/* a bit mask of SIZE_WORD quality characters which are below */
+  unsigned int mask = 0;
+  int i;
+
+  for (i = 0; i < SIZE_WORD; i++)
+  { if ((int)q[i] < below) { mask |= 1U << i; } }
+  return mask;
+}
+
+
+#ifdef X86_KERNELS
+TARGET("sse4.2") unsigned int quality_sse42(const char *q, int below)
+{
+  const __m128i t = _mm_set1_epi8((char)below);
+  __m128i lo, hi;
+
+  if (below > 127) { return ~0U; }
+  if (below < -127) { return 0U; }
+  lo = _mm_cmpgt_epi8(t, _mm_loadu_si128((const __m128i *)q));
+  hi = _mm_cmpgt_epi8(t, _mm_loadu_si128((const __m128i *)(q + 16)));
+  return (unsigned int)_mm_movemask_epi8(lo) |
+         ((unsigned int)_mm_movemask_epi8(hi) << 16);
+}
+
+
+TARGET("avx2") unsigned int quality_avx2(const char *q, int below)
+{
+  if (below > 127) { return ~0U; }
+  if (below < -127) { return 0U; }
+  return (unsigned int)_mm256_movemask_epi8(_mm256_cmpgt_epi8(
+    _mm256_set1_epi8((char)below), _mm256_loadu_si256((const __m256i *)q)));
+}
+
+
+TARGET("avx512f,avx512bw,avx512vl")
+unsigned int quality_avx512(const char *q, int below)
+{
+  if (below > 127) { return ~0U; }
+  if (below < -127) { return 0U; }
+  return (unsigned int)_mm256_cmpgt_epi8_mask(_mm256_set1_epi8((char)below),
+    _mm256_loadu_si256((const __m256i *)q));
+}
+#endif
+
+
+unsigned int (*low_quality)(const char *, int) = quality_scalar;
+
+
+long int valid_run(long int pos)
+{	/* number of bases from pos which can be counted */
+  long int lo, hi, mid;
+
+  if (pos >= gnsize) { return 0L; }
+  if (gap_cursor > 0 && gaps[gap_cursor - 1].end > pos)
+  {	/* moved backward, search for the first gap ending after pos */
+    for (lo = 0, hi = gap_cursor - 1; lo < hi; )
+    {
+      mid = (lo + hi) / 2;
+      if (gaps[mid].end <= pos) { lo = mid + 1; } else { hi = mid; }
+    }
+    gap_cursor = lo;
+  }
+  while (gap_cursor < num_gaps && gaps[gap_cursor].end <= pos)
+  { gap_cursor++; }
+  if (gap_cursor == num_gaps) { return gnsize - pos; }
+  if (gaps[gap_cursor].start <= pos) { return 0L; }
+  return gaps[gap_cursor].start - pos;
+}
+
+
+const char *line_end(const char *p, const char *end, int final)
+{	/* the newline of the line from p, or NULL if it is not complete */
+  const char *q;
+
+  if (p == end) { return NULL; }
+  q = (const char *)memchr(p, '\n', end - p);
+  if (q == NULL && final != 0) { q = end; }	/* no newline at the end */
+  return q;
+}
+
+
+long int line_length(const char *p, const char *q)
+{	/* without CR of CRLF */
+  return (long int)(q - p) - ((q > p && q[-1] == '\r') ? 1 : 0);
+}
+
+
+long int join_lines(char *dst, const char *p, const char *end, long int length)
+{	/* copy length characters of successive lines without line breaks */
+  const char *q;
+  long int i, n;
+
+  for (i = 0; i < length; i += n, p = q + 1)
+  {
+    q = (const char *)memchr(p, '\n', end - p);
+    if (q == NULL) { q = end; }	/* the last line of the input */
+    n = line_length(p, q);
+    memcpy(dst + i, p, n);
+  }
+  return i;
+}
+
+
+long int put_fastq(struct store *st, const char *seq, const char *qual,
+                   long int basepairs)
+{	/* encode bases and mask low quality ones in the same pass */
+  long int i, j;
+  unsigned long word;
+  unsigned int invalid, low;
+  int below = minimum_qscore - CODE_TO_SCORE;
+
+  for (i = 0; basepairs - i >= SIZE_WORD; )
+  {
+    word = encode_bases(seq + i, &invalid);
+    low = low_quality(qual + i, below);
+    if ((invalid | low) == 0)
+    { put_word(st, word, SIZE_WORD); i += SIZE_WORD; continue; }
+    for (j = 0; j < SIZE_WORD; j++, i++)
+    {
+      if (((low >> j) & 1) != 0) { put_gap(st, 1L); }
+      else { put_base(st, seq[i]); }
+    }
+  }
+  for (; i < basepairs; i++)
+  {
+    if ((int)qual[i] < below) { put_gap(st, 1L); }
+    else { put_base(st, seq[i]); }
+  }
+  return basepairs;
+}
+
+
+long int put_bam(struct store *st, const unsigned char *seq, const char *qual,
+                 long int basepairs, int below)
+{	/* append 4-bit bases of BAM, the first one in the high bits of a */
+	/* byte, masking low quality ones as put_fastq()                  */
+  static unsigned char codes[256], others[256];
+  long int i, j;
+  unsigned long word;
+  unsigned int invalid, n;
+
+  if (others[0] == 0)	/* =ACMGRSVTWYHKDBN, only A, C, G, and T are bases */
+  {
+    for (i = 0; i < 256; i++)
+    {
+      for (j = 0; j < 2; j++)
+      {
+        n = (unsigned int)(i >> ((1 - j) << 2)) & 15;
+        switch (n)
+        {
+          case 1:  codes[i] |= (unsigned char)(2 << (j << 1)); break;
+          case 2:  codes[i] |= (unsigned char)(1 << (j << 1)); break;
+          case 4:  codes[i] |= (unsigned char)(3 << (j << 1)); break;
+          case 8:  break;
+          default: others[i] |= (unsigned char)(1 << j);
+        }
+      }
+    }
+  }
+  for (i = 0; basepairs - i >= SIZE_WORD; i += SIZE_WORD)
+  {
+    for (j = 0, word = 0, invalid = 0; j < SIZE_WORD / 2; j++)
+    {
+      n = seq[(i >> 1) + j];
+      word |= (unsigned long)codes[n] << (j << 2);
+      invalid |= (unsigned int)others[n] << (j << 1);
+    }
+    invalid |= low_quality(qual + i, below);
+    if (invalid == 0) { put_word(st, word, SIZE_WORD); continue; }
+    for (j = 0; j < SIZE_WORD; j++)
+    {
+      if (((invalid >> j) & 1) != 0) { put_gap(st, 1L); }
+      else { put_code(st, (int)(word >> (j << 1)) & 3); }
+    }
+  }
+  for (; i < basepairs; i++)
+  {
+    n = seq[i >> 1];
+    if ((int)qual[i] < below || ((others[n] >> (i & 1)) & 1) != 0)
+    { put_gap(st, 1L); }
+    else { put_code(st, (codes[n] >> ((i & 1) << 1)) & 3); }
+  }
+  return basepairs;
+}
+
+
+long int parse_bam(struct store *st, const char *p, const char *end, int final)
+{	/* the header or a record of BAM; the bytes used are returned, 0 if */
+	/* it is not complete, or -1 when the genome is full                 */
+  const unsigned char *r = (const unsigned char *)p, *seq;
+  long int size, i, number = 0, basepairs;
+  unsigned int flag;
+
+  if (st->in_records == 0)	/* text and references */
+  {
+    size = (end - p >= 8) ? 12 + (long int)twobit_int(r + 4, 4, 0) : 12;
+    if (end - p >= size) { number = (long int)twobit_int(r + size - 4, 4, 0); }
+    for (i = 0; end - p >= size && i < number; i++)
+    {
+      size += 8;
+      if (end - p >= size - 4)
+      { size += (long int)twobit_int(r + size - 8, 4, 0); }
+    }
+    if (end - p >= size) { st->in_records = 1; return size; }
+  }
+  else
+  {
+    size = (end - p >= 4) ? 4 + (long int)twobit_int(r, 4, 0) : 4;
+    if (size < 36 && end - p >= 4)
+    { fprintf(stderr, "Error 25: broken BAM record\n"); exit(EXIT_FAILURE); }
+    if (end - p >= size)
+    {
+      flag = (unsigned int)twobit_int(r + 18, 2, 0);
+      basepairs = (long int)twobit_int(r + 20, 4, 0);
+      seq = r + 36 + r[12] + 4 * (long int)twobit_int(r + 16, 2, 0);
+      if (basepairs > size || seq + (basepairs + 1) / 2 + basepairs > r + size)
+      { fprintf(stderr, "Error 25: broken BAM record\n"); exit(EXIT_FAILURE); }
+      if ((flag & BAM_SKIPPED) != 0) { return size; }
+      put_gap(st, 1L);	/* insert n to split the two reads */
+      if (genome_full(st, basepairs) != 0) { return -1L; }
+      put_bam(st, seq, (const char *)seq + (basepairs + 1) / 2, basepairs,
+              (basepairs > 0 && seq[(basepairs + 1) / 2] == 0xFF) ?
+              -128 : minimum_qscore);
+      st->gsize += basepairs;	/* 0xFF is the quality of no quality */
+      return size;
+    }
+  }
+  if (final != 0 && p < end)
+  { fprintf(stderr, "Error 25: BAM is truncated\n"); exit(EXIT_FAILURE); }
+  return 0L;
+}
+
+
+long int parse_fastq(struct store *st, const char *p, const char *end,
+                     int final)
+{	/* a record of a header, sequence lines, a + line, and quality lines */
+	/* as long as the sequence; the bytes used are returned, 0 if it is */
+	/* not complete, or -1 when the genome is full                       */
+  const char *q, *seq, *qual, *r;
+  long int basepairs = 0, quals = 0, lines, wrapped = 0;
+  char *tmp;
+
+  q = line_end(p, end, final);	/* the header is complete */
+  r = seq = (q < end) ? q + 1 : q;
+  for (lines = 0; (q = line_end(r, end, final)) == NULL || *r != '+'; lines++)
+  {
+    if (q == NULL)
+    {
+      if (final == 0) { return 0L; }
+      fprintf(stderr, (lines == 0) ? "Error 10: FASTQ sequence is missing\n"
+                                   : "Error 11: FASTQ + line is missing\n");
+      exit(EXIT_FAILURE);
+    }
+    basepairs += line_length(r, q);
+    r = (q < end) ? q + 1 : q;
+  }
+  wrapped += (lines > 1);
+  r = qual = (q < end) ? q + 1 : q;
+  for (lines = 0; lines == 0 || quals < basepairs; lines++)
+  {
+    if ((q = line_end(r, end, final)) == NULL)
+    {
+      if (final == 0) { return 0L; }
+      fprintf(stderr, "Error 12: FASTQ quality is missing\n");
+      exit(EXIT_FAILURE);
+    }
+    quals += line_length(r, q);
+    r = (q < end) ? q + 1 : q;
+  }
+  wrapped += (lines > 1);
+  if (quals != basepairs)
+  {
+    fprintf(stderr, "Error 24: FASTQ quality is longer than the sequence\n");
+    exit(EXIT_FAILURE);
+  }
+  put_gap(st, 1L);	/* insert n to split the two scaffolds */
+  if (genome_full(st, basepairs) != 0) { return -1L; }
+  if (wrapped != 0)	/* join the lines of sequence and of quality */
+  {
+    if (st->size_wrap < basepairs * 2)
+    {
+      tmp = (char *)realloc(st->wrap, basepairs * 2);
+      if (tmp == NULL)
+      {
+        fprintf(stderr, "Error 15: realloc for a FASTQ record\n");
+        exit(EXIT_FAILURE);
+      }
+      st->wrap = tmp;
+      st->size_wrap = basepairs * 2;
+    }
+    join_lines(st->wrap, seq, end, basepairs);
+    join_lines(st->wrap + basepairs, qual, end, basepairs);
+    seq  = st->wrap;
+    qual = st->wrap + basepairs;
+  }
+  put_fastq(st, seq, qual, basepairs);
+  st->gsize += basepairs;
+  return (long int)(r - p);
+}
+
+
+long int parse_block(struct store *st, const char *buf, long int length,
+                     int final)
+{	/* parse complete lines or records, and return the number of bytes  */
+	/* used; -1 is returned when the genome is full                      */
+  const char *p = buf, *end = buf + length, *q;
+  long int j, basepairs;
+  unsigned long word;
+  unsigned int invalid;
+
+  while (p < end)
+  {
+    if (piped != 0 && rows >= size_data) { return -1L; }	/* done */
+    if (fastq == 1)	/* FASTQ, a record of lines */
+    {
+      if ((q = line_end(p, end, final)) == NULL) { break; }
+      if (line_length(p, q) == 0)	/* an empty line */
+      { p = (q < end) ? q + 1 : q; continue; }
+      if (*p != '@')
+      {
+        fprintf(stderr, "Error 14: FASTQ record without @\n");
+        exit(EXIT_FAILURE);
+      }
+      if ((basepairs = parse_fastq(st, p, end, final)) == 0) { break; }
+      if (basepairs == -1) { return -1L; }
+      p += basepairs;
+      continue;	/* the next record */
+    }
+    else if (fastq == 2)	/* BAM, records of their sizes */
+    {
+      if ((basepairs = parse_bam(st, p, end, final)) == 0) { break; }
+      if (basepairs == -1) { return -1L; }
+      p += basepairs;
+      continue;
+    }
+    else	/* FASTA */
+    {
+      if ((q = line_end(p, end, final)) == NULL) { break; }
+      if (*p == '>')	/* insert n to split the two scaffolds */
+      { put_gap(st, 1L); put_record(st, p + 1, q, 0L); }
+      else
+      {
+        basepairs = (long int)(q - p) + ((q < end) ? 1 : 0);
+        if (genome_full(st, basepairs) != 0) { return -1L; }
+        for (basepairs = 0; q - p >= SIZE_WORD; p += SIZE_WORD)
+        {
+          word = encode_bases(p, &invalid);
+          if (invalid == 0)
+          { put_word(st, word, SIZE_WORD); basepairs += SIZE_WORD; }
+          else	/* ns, other letters or spaces */
+          {
+            for (j = 0; j < SIZE_WORD; j++)
+            { if (isalpha(p[j]) != 0) { put_base(st, p[j]); basepairs++; } }
+          }
+        }
+        for (; p < q; p++)
+        { if (isalpha(*p) != 0) { put_base(st, *p); basepairs++; } }
+        st->gsize += basepairs;
+      }
+    }
+    p = (q < end) ? q + 1 : q;
+  }
+  return (long int)(p - buf);
+}
+
+
+int detect_format(const char *p, long int length)
+{	/* the first character tells FASTA or FASTQ */
+  if (length > 0 && *p == '>')      { fastq = 0; }
+  else if (length > 0 && *p == '@') { fastq = 1; }
+  else if (length >= 4 && memcmp(p, BAM_MAGIC, 4) == 0) { fastq = 2; }
+  else
+  {
+    fprintf(stderr, "Error 7: neither FASTA, FASTQ, nor BAM\n");
+    exit(EXIT_FAILURE);
+  }
+  return (int)fastq;
+}
+
+
+long int read_file(void *src, char *buf, long int size)
+{	/* a reader for read_stream() */
+  return (long int)fread(buf, 1, size, (FILE *)src);
+}
+
+
+long int read_stream(struct store *st,
+                     long int (*get)(void *, char *, long int), void *src)
+{	/* parse a stream through a buffer which keeps incomplete lines */
+  char *buf, *tmp;
+  long int size_buf = SIZE_BLOCK, filled = 0, used, got;
+  int eof = 0;
+
+  buf = (char *)malloc(size_buf);
+  if (buf == NULL)
+  { fprintf(stderr, "Error 15: malloc for buf\n"); exit(EXIT_FAILURE); }
+  while (eof == 0)
+  {
+    if (filled == size_buf)	/* a line or a record longer than buf */
+    {
+      tmp = (char *)realloc(buf, size_buf * 2);
+      if (tmp == NULL)
+      { fprintf(stderr, "Error 15: realloc for buf\n"); exit(EXIT_FAILURE); }
+      buf = tmp;
+      size_buf *= 2;
+    }
+    got = get(src, buf + filled, size_buf - filled);
+    if (got == 0) { eof = 1; }
+    if (fastq == -1)
+    {
+      if (got == 0)
+      { fprintf(stderr, "Error 6: fread()\n"); exit(EXIT_FAILURE); }
+      if (got >= 4 &&
+          (twobit_int((unsigned char *)buf, 4, 0) == TWOBIT_SIGNATURE ||
+           twobit_int((unsigned char *)buf, 4, 1) == TWOBIT_SIGNATURE))
+      {
+        fprintf(stderr, "Error 18: .2bit is not a regular file\n");
+        exit(EXIT_FAILURE);
+      }
+      detect_format(buf, got);
+    }
+    filled += got;
+    used = parse_block(st, buf, filled, eof);
+    if (used == -1) { break; }	/* the genome is full */
+    memmove(buf, buf + used, filled - used);
+    filled -= used;
+  }
+  free(buf);
+  return st->gnsize;
+}
+
+
+void *inflate_ring(void *arg)
+{	/* the thread which fills the ring; concatenated members are read */
+  struct inflater *gz = (struct inflater *)arg;
+  unsigned char *in = NULL;
+  long int done = 0, slot;
+  z_stream zs;
+  int rv, ended = 0, error, eof = 0;	/* ended at the end of a member */
+
+  memset(&zs, 0, sizeof(zs));
+  error = (inflateInit2(&zs, 15 + 32) != Z_OK);
+  if (gz->fp != NULL && (in = (unsigned char *)malloc(SIZE_BLOCK)) == NULL)
+  { error = 1; }
+  pthread_mutex_lock(&gz->lock);
+  while (error == 0 && eof == 0)
+  {
+    while (gz->count == SIZE_RING && gz->stop == 0)
+    { pthread_cond_wait(&gz->cond, &gz->lock); }
+    if (gz->stop != 0) { break; }
+    slot = (gz->first + gz->count) % SIZE_RING;
+    pthread_mutex_unlock(&gz->lock);
+    zs.next_out  = (unsigned char *)gz->block[slot];
+    zs.avail_out = SIZE_BLOCK;
+    while (zs.avail_out > 0)
+    {
+      if (zs.avail_in == 0)	/* more input */
+      {
+        if (gz->fp != NULL)
+        {
+          zs.next_in  = in;
+          zs.avail_in = (unsigned int)fread(in, 1, SIZE_BLOCK, gz->fp);
+        }
+        else if (done < gz->length)
+        {
+          zs.next_in  = (unsigned char *)gz->map + done;
+          zs.avail_in = (unsigned int)((gz->length - done < SIZE_BLOCK) ?
+                                       gz->length - done : SIZE_BLOCK);
+          done += zs.avail_in;
+        }
+        if (zs.avail_in == 0) { break; }	/* end of the input */
+      }
+      rv = inflate(&zs, Z_NO_FLUSH);
+      ended = (rv == Z_STREAM_END);
+      if (ended != 0) { inflateReset(&zs); }	/* the next member */
+      else if (rv != Z_OK && rv != Z_BUF_ERROR) { error = 1; break; }
+    }
+    if (zs.avail_out > 0 && ended == 0) { error = 1; }	/* truncated */
+    eof = (zs.avail_out > 0);
+    pthread_mutex_lock(&gz->lock);
+    gz->filled[slot] = SIZE_BLOCK - (long int)zs.avail_out;
+    gz->count++;
+    pthread_cond_broadcast(&gz->cond);
+  }
+  if (error != 0) { gz->error = 1; }	/* shared only under the lock */
+  gz->eof = 1;
+  pthread_cond_broadcast(&gz->cond);
+  pthread_mutex_unlock(&gz->lock);
+  inflateEnd(&zs);
+  free(in);
+  return NULL;
+}
+
+
+long int read_ring(void *src, char *buf, long int size)
+{	/* a reader for read_stream(), copying from the first block */
+  struct inflater *gz = (struct inflater *)src;
+  long int n = 0;
+
+  pthread_mutex_lock(&gz->lock);
+  while (gz->count == 0 && gz->eof == 0)
+  { pthread_cond_wait(&gz->cond, &gz->lock); }
+  if (gz->error != 0)
+  { fprintf(stderr, "Error 20: broken gzip data\n"); exit(EXIT_FAILURE); }
+  if (gz->count > 0)
+  {
+    n = gz->filled[gz->first] - gz->offset;
+    if (n > size) { n = size; }
+    memcpy(buf, gz->block[gz->first] + gz->offset, n);
+    gz->offset += n;
+    if (gz->offset == gz->filled[gz->first])	/* give the block back */
+    {
+      gz->first = (gz->first + 1) % SIZE_RING;
+      gz->count--;
+      gz->offset = 0;
+      pthread_cond_broadcast(&gz->cond);
+    }
+  }
+  pthread_mutex_unlock(&gz->lock);
+  return n;
+}
+
+
+long int read_gzip(struct store *st, FILE *fp, const unsigned char *map,
+                   long int length)
+{	/* decompress in another thread while parsing in this thread */
+  struct inflater gz;
+  int i;
+
+  memset(&gz, 0, sizeof(gz));
+  gz.fp     = fp;
+  gz.map    = map;
+  gz.length = length;
+  for (i = 0; i < SIZE_RING; i++)
+  {
+    if ((gz.block[i] = (char *)malloc(SIZE_BLOCK)) == NULL)
+    {
+      fprintf(stderr, "Error 15: malloc for gzip blocks\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  pthread_mutex_init(&gz.lock, NULL);
+  pthread_cond_init(&gz.cond, NULL);
+  if (pthread_create(&gz.tid, NULL, inflate_ring, &gz) != 0)
+  {
+    fprintf(stderr, "Error 16: pthread_create for gzip\n");
+    exit(EXIT_FAILURE);
+  }
+  read_stream(st, read_ring, &gz);
+  pthread_mutex_lock(&gz.lock);	/* the parser may stop early */
+  gz.stop = 1;
+  pthread_cond_broadcast(&gz.cond);
+  pthread_mutex_unlock(&gz.lock);
+  pthread_join(gz.tid, NULL);
+  pthread_cond_destroy(&gz.cond);
+  pthread_mutex_destroy(&gz.lock);
+  for (i = 0; i < SIZE_RING; i++) { free(gz.block[i]); }
+  return st->gnsize;
+}
+
+
+long int bgzf_block_size(const unsigned char *p, long int avail)
+{	/* the size of a BGZF block from its header, or 0 for others */
+  long int xlen, i;
+
+  if (avail < 18 || p[0] != 0x1F || p[1] != 0x8B || p[2] != 8 ||
+      (p[3] & 4) == 0)
+  { return 0L; }
+  xlen = p[10] | (p[11] << 8);
+  for (i = 12; i + 4 <= 12 + xlen && i + 6 <= avail;
+       i += 4 + (p[i + 2] | (p[i + 3] << 8)))
+  {	/* BC is the subfield of the block size */
+    if (p[i] == 'B' && p[i + 1] == 'C' && p[i + 2] == 2 && p[i + 3] == 0)
+    { return (long int)(p[i + 4] | (p[i + 5] << 8)) + 1; }
+  }
+  return 0L;
+}
+
+
+long int bgzf_index(struct bgzf *bz, const char *path)
+{	/* offsets of the blocks, from .gzi or from the headers */
+  char *name;
+  FILE *fp;
+  unsigned char entry[16];
+  long int i, n = 0, size, max;
+
+  max = bz->length / 28 + 2;	/* an empty block takes 28 bytes */
+  bz->coffset = (long int *)malloc(sizeof(long int) * max);
+  bz->uoffset = (long int *)malloc(sizeof(long int) * max);
+  name = (char *)malloc(strlen(path) + strlen(GZI_SUFFIX) + 1);
+  if (bz->coffset == NULL || bz->uoffset == NULL || name == NULL)
+  {
+    fprintf(stderr, "Error 21: malloc for BGZF blocks\n");
+    exit(EXIT_FAILURE);
+  }
+  sprintf(name, "%s%s", path, GZI_SUFFIX);
+  bz->coffset[0] = bz->uoffset[0] = 0;
+  if ((fp = fopen(name, "rb")) != NULL && fread(entry, 8, 1, fp) == 1)
+  {	/* little endian pairs after the first block */
+    n = (long int)twobit_int(entry, 8, 0);
+    if (n < 0 || n + 1 >= max) { n = 0; }
+    for (i = 1; i <= n; i++)
+    {
+      if (fread(entry, 16, 1, fp) != 1) { n = 0; break; }
+      bz->coffset[i] = (long int)twobit_int(entry, 8, 0);
+      bz->uoffset[i] = (long int)twobit_int(entry + 8, 8, 0);
+      if (bz->coffset[i] <= bz->coffset[i - 1] ||
+          bz->coffset[i] >= bz->length ||
+          bgzf_block_size(bz->map + bz->coffset[i],
+                          bz->length - bz->coffset[i]) == 0)
+      { n = 0; break; }	/* not for this file */
+    }
+  }
+  if (fp != NULL) { fclose(fp); }
+  free(name);
+  for (i = bz->coffset[n]; i < bz->length && n + 1 < max; i += size, n++)
+  {	/* walk through the headers after the last indexed block */
+    size = bgzf_block_size(bz->map + i, bz->length - i);
+    if (size < 26 || i + size > bz->length)
+    { fprintf(stderr, "Error 22: broken BGZF block\n"); exit(EXIT_FAILURE); }
+    bz->coffset[n] = i;
+    bz->uoffset[n + 1] = bz->uoffset[n] +
+                         (long int)twobit_int(bz->map + i + size - 4, 4, 0);
+  }
+  bz->coffset[n] = bz->length;
+  bz->num_blocks = n;
+  return n;
+}
+
+
+long int inflate_block(z_stream *zs, const unsigned char *p, long int size,
+                       char *out)
+{	/* inflate a BGZF block of size bytes into out, which has SIZE_BGZF */
+	/* bytes; -1 is returned if it does not match its CRC32 and ISIZE   */
+  long int xlen = p[10] | (p[11] << 8);
+
+  if (size < 20 + xlen) { return -1L; }
+  inflateReset(zs);
+  zs->next_in   = (unsigned char *)p + 12 + xlen;
+  zs->avail_in  = (unsigned int)(size - 12 - xlen - 8);
+  zs->next_out  = (unsigned char *)out;
+  zs->avail_out = SIZE_BGZF;
+  if (inflate(zs, Z_FINISH) != Z_STREAM_END ||
+      (long int)zs->total_out != (long int)twobit_int(p + size - 4, 4, 0) ||
+      crc32(0L, (unsigned char *)out, (unsigned int)zs->total_out)
+        != twobit_int(p + size - 8, 4, 0))
+  { return -1L; }
+  return (long int)zs->total_out;
+}
+
+
+void *inflate_batches(void *arg)
+{	/* a thread which takes the next batch when its slot is emptied */
+  struct bgzf *bz = (struct bgzf *)arg;
+  long int j, k, last, slot, filled, got;
+  z_stream zs;
+  int error;
+
+  memset(&zs, 0, sizeof(zs));
+  error = (inflateInit2(&zs, -15) != Z_OK);	/* raw deflate in each block */
+  pthread_mutex_lock(&bz->lock);
+  for (;;)
+  {
+    while (bz->stop == 0 && bz->next * BGZF_BATCH < bz->num_blocks &&
+           bz->next >= bz->batch + SIZE_RING)
+    { pthread_cond_wait(&bz->cond, &bz->lock); }
+    if (bz->stop != 0 || bz->next * BGZF_BATCH >= bz->num_blocks) { break; }
+    j = bz->next++;
+    pthread_mutex_unlock(&bz->lock);
+    slot = j % SIZE_RING;
+    last = (j + 1) * BGZF_BATCH;
+    if (last > bz->num_blocks) { last = bz->num_blocks; }
+    for (k = j * BGZF_BATCH, filled = 0; error == 0 && k < last; k++)
+    {
+      got = inflate_block(&zs, bz->map + bz->coffset[k],
+                          bz->coffset[k + 1] - bz->coffset[k],
+                          bz->slot[slot] + filled);
+      if (got == -1) { error = 1; } else { filled += got; }
+    }
+    pthread_mutex_lock(&bz->lock);
+    bz->filled[slot] = filled;
+    bz->ready[slot]  = j;
+    if (error != 0) { bz->error = 1; }
+    pthread_cond_broadcast(&bz->cond);
+  }
+  pthread_mutex_unlock(&bz->lock);
+  inflateEnd(&zs);
+  return NULL;
+}
+
+
+long int read_batches(void *src, char *buf, long int size)
+{	/* a reader for read_stream(), copying from the batches in order */
+  struct bgzf *bz = (struct bgzf *)src;
+  long int n = 0, slot;
+
+  pthread_mutex_lock(&bz->lock);
+  while (n == 0 && bz->batch * BGZF_BATCH < bz->num_blocks)
+  {
+    slot = bz->batch % SIZE_RING;
+    while (bz->ready[slot] != bz->batch && bz->error == 0)
+    { pthread_cond_wait(&bz->cond, &bz->lock); }
+    if (bz->error != 0)
+    { fprintf(stderr, "Error 22: broken BGZF block\n"); exit(EXIT_FAILURE); }
+    n = bz->filled[slot] - bz->offset;
+    if (n > size) { n = size; }
+    memcpy(buf, bz->slot[slot] + bz->offset, n);
+    bz->offset += n;
+    if (bz->offset == bz->filled[slot])	/* give the slot back */
+    {
+      bz->ready[slot] = -1;
+      bz->batch++;
+      bz->offset = 0;
+      pthread_cond_broadcast(&bz->cond);
+    }
+  }
+  pthread_mutex_unlock(&bz->lock);
+  return n;
+}
+
+
+long int read_bgzf(struct store *st, const char *path,
+                   const unsigned char *map, long int length)
+{	/* decompress batches of blocks in -j threads while parsing them */
+  struct bgzf bz;
+  pthread_t *tid;
+  int i, number = (threads > 1) ? threads : 1, *started;
+
+  memset(&bz, 0, sizeof(bz));
+  bz.map    = map;
+  bz.length = length;
+  bgzf_index(&bz, path);
+  tid = (pthread_t *)malloc(sizeof(pthread_t) * number);
+  started = (int *)calloc(number, sizeof(int));
+  if (tid == NULL || started == NULL)
+  { fprintf(stderr, "Error 16: malloc for threads\n"); exit(EXIT_FAILURE); }
+  for (i = 0; i < SIZE_RING; i++)
+  {
+    bz.ready[i] = -1;
+    if ((bz.slot[i] = (char *)malloc(SIZE_BGZF * BGZF_BATCH)) == NULL)
+    {
+      fprintf(stderr, "Error 15: malloc for BGZF batches\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  pthread_mutex_init(&bz.lock, NULL);
+  pthread_cond_init(&bz.cond, NULL);
+  for (i = 0; i < number; i++)
+  { started[i] = (pthread_create(&tid[i], NULL, inflate_batches, &bz) == 0); }
+  if (started[0] == 0)
+  {
+    fprintf(stderr, "Error 16: pthread_create for BGZF\n");
+    exit(EXIT_FAILURE);
+  }
+  read_stream(st, read_batches, &bz);
+  pthread_mutex_lock(&bz.lock);	/* the parser may stop early */
+  bz.stop = 1;
+  pthread_cond_broadcast(&bz.cond);
+  pthread_mutex_unlock(&bz.lock);
+  for (i = 0; i < number; i++) { if (started[i] != 0)
+  { pthread_join(tid[i], NULL); } }
+  pthread_cond_destroy(&bz.cond);
+  pthread_mutex_destroy(&bz.lock);
+  for (i = 0; i < SIZE_RING; i++) { free(bz.slot[i]); }
+  free(bz.coffset);
+  free(bz.uoffset);
+  free(started);
+  free(tid);
+  return st->gnsize;
+}
+
+
+int four_lines(const char *p, const char *end)
+{	/* whether every FASTQ record is of four lines, so that */
+	/* next_record() cannot take a wrapped quality line       */
+	/* beginning with @ for a record                          */
+  const char *line[5];
+  int i;
+
+  while (p < end)
+  {
+    if (*p == '\n' || *p == '\r')	/* an empty line */
+    {
+      if ((p = (const char *)memchr(p, '\n', end - p)) == NULL) { return 1; }
+      p++;
+      continue;
+    }
+    for (i = 0, line[0] = p; i < 4; i++)
+    {
+      line[i + 1] = (const char *)memchr(line[i], '\n', end - line[i]);
+      line[i + 1] = (line[i + 1] == NULL) ? end : line[i + 1] + 1;
+      if (line[i + 1] == end && i < 3) { return 0; }
+    }
+    if (*line[0] != '@' || *line[2] != '+' ||
+        line_length(line[1], line[2] - 1) !=
+        line_length(line[3], line[4] - (line[4][-1] == '\n')))
+    { return 0; }
+    p = line[4];
+  }
+  return 1;
+}
+
+
+void *parse_slice(void *arg)
+{	/* a thread to parse a slice */
+  struct slice *sl = (struct slice *)arg;
+
+  if (sl->st.dry != 0 && fastq == 1 &&
+      four_lines(sl->buf, sl->buf + sl->length) == 0)
+  { sl->used = -1; return NULL; }	/* parsed by a single thread instead */
+  sl->used = parse_block(&sl->st, sl->buf, sl->length, 1);
+  return NULL;
+}
+
+
+const char *next_record(const char *p, const char *end)
+{	/* the beginning of a line which can be parsed independently:  */
+	/* any line in FASTA, and @ followed by a + line two lines later */
+	/* in FASTQ and by a quality line as long as the sequence        */
+  const char *line[5];
+  int i;
+
+  while (p < end)
+  {
+    if ((p = (const char *)memchr(p, '\n', end - p)) == NULL) { return end; }
+    p++;
+    if (fastq == 0 || p == end) { return p; }
+    if (*p != '@') { continue; }
+    for (i = 0, line[0] = p; i < 4; i++)
+    {
+      line[i + 1] = (const char *)memchr(line[i], '\n', end - line[i]);
+      if (line[i + 1] == NULL) { return end; }
+      line[i + 1]++;
+    }
+    if (*line[2] == '+' &&
+        line_length(line[1], line[2] - 1) == line_length(line[3], line[4] - 1))
+    { return p; }
+  }
+  return end;
+}
+
+
+int fastq_wrapped(const char *p, const char *end)
+{	/* whether the first record has more than one sequence line */
+  int i;
+
+  for (i = 0; i < 2 && p != NULL && p < end; i++)
+  {
+    if ((p = (const char *)memchr(p, '\n', end - p)) != NULL) { p++; }
+  }
+  return (p == NULL || p >= end || *p != '+');
+}
+
+
+int run_slices(struct slice *sl, int number)
+{	/* parse slices in parallel; the first one in this thread */
+  pthread_t *tid;
+  int i, *started;
+
+  tid = (pthread_t *)malloc(sizeof(pthread_t) * number);
+  started = (int *)calloc(number, sizeof(int));
+  if (tid == NULL || started == NULL)
+  { fprintf(stderr, "Error 16: malloc for threads\n"); exit(EXIT_FAILURE); }
+  for (i = 1; i < number; i++)
+  { started[i] = (pthread_create(&tid[i], NULL, parse_slice, &sl[i]) == 0); }
+  parse_slice(&sl[0]);
+  for (i = 1; i < number; i++)
+  {
+    if (started[i] != 0) { pthread_join(tid[i], NULL); }
+    else                 { parse_slice(&sl[i]); }	/* no more threads */
+  }
+  free(started);
+  free(tid);
+  return number;
+}
+
+
+long int read_parallel(struct store *st, const char *map, long int length)
+{	/* count the bases of each slice, then parse them into their places */
+  struct slice *sl;
+  const char *p = map, *end = map + length;
+  long int i, j, number = threads, start = st->gnsize, size;
+
+  if (number > length / SIZE_BLOCK + 1) { number = length / SIZE_BLOCK + 1; }
+  sl = (struct slice *)calloc(number, sizeof(struct slice));
+  if (sl == NULL)
+  { fprintf(stderr, "Error 16: malloc for slices\n"); exit(EXIT_FAILURE); }
+  for (i = 0; i < number; i++)
+  {
+    sl[i].buf = p;
+    if (i == number - 1) { p = end; }
+    else if (p < map + length / number * (i + 1))
+    { p = next_record(map + length / number * (i + 1) - 1, end); }
+    sl[i].length = (long int)(p - sl[i].buf);
+    sl[i].st.head = sl[i].st.tail = -1;
+    sl[i].st.dry = 1;
+  }
+  run_slices(sl, (int)number);
+  for (i = 0; i < number; i++)	/* the place of each slice */
+  {
+    if (sl[i].used == -1) { break; }
+    size = sl[i].st.gnsize;
+    sl[i].st.gnsize = start;
+    sl[i].st.gsize = 0;
+    sl[i].st.head = ((start & 3) != 0) ? start >> 2 : -1;
+    sl[i].st.tail = (((start + size) & 3) != 0) ? (start + size) >> 2 : -1;
+    sl[i].st.dry = 0;
+    start += size;
+  }
+  if (i < number || (size_genome != 0 && size_genome - 1 < start))
+  {	/* a slice failed, or -g truncates the whole: as a single thread */
+    for (i = 0; i < number; i++) { free(sl[i].st.wrap); }
+    free(sl);
+    return parse_block(st, map, length, 1);
+  }
+  reserve_genome(start);
+  run_slices(sl, (int)number);
+  for (i = 0; i < number; i++)	/* join the slices */
+  {
+    if (sl[i].st.head != -1)
+    { genome[sl[i].st.head] |= (unsigned char)sl[i].st.head_bits; }
+    if (sl[i].st.tail != -1)
+    { genome[sl[i].st.tail] |= (unsigned char)sl[i].st.tail_bits; }
+    for (j = 0; j < sl[i].st.num_gaps; j++)
+    {
+      st->gnsize = sl[i].st.gaps[j].start;
+      put_gap(st, sl[i].st.gaps[j].end - sl[i].st.gaps[j].start);
+    }
+    for (j = 0; j < sl[i].st.num_records; j++)
+    {
+      st->gnsize = sl[i].st.records[j].start;
+      put_record(st, sl[i].st.records[j].name, sl[i].st.records[j].name +
+                 strlen(sl[i].st.records[j].name), sl[i].st.records[j].offset);
+      free(sl[i].st.records[j].name);
+    }
+    st->gsize += sl[i].st.gsize;
+    free(sl[i].st.records);
+    free(sl[i].st.gaps);
+    free(sl[i].st.wrap);
+  }
+  st->gnsize = start;
+  free(sl);
+  return length;
+}
+
+
+long int put_twobit(struct store *st, const unsigned char *dna, long int from,
+                    long int to)
+{	/* append bases [from, to) of a .2bit record, in which the first */
+	/* base of each byte is in the highest bits                       */
+  static unsigned char flip[256];
+  unsigned long word;
+  int i;
+
+  if (flip[1] == 0)	/* reverse the order of bases in a byte */
+  {
+    for (i = 0; i < 256; i++)
+    {
+      flip[i] = (unsigned char)((i >> 6) | ((i >> 2) & 0x0C) |
+                                ((i << 2) & 0x30) | (i << 6));
+    }
+  }
+  for (; from < to && (from & 3) != 0; from++)
+  { put_code(st, (dna[from >> 2] >> (6 - ((from & 3) << 1))) & 3); }
+  for (; to - from >= SIZE_WORD; from += SIZE_WORD)
+  {
+    for (i = 0, word = 0; i < 8; i++)
+    { word |= (unsigned long)flip[dna[(from >> 2) + i]] << (i << 3); }
+    put_word(st, word, SIZE_WORD);
+  }
+  for (; from < to; from++)
+  { put_code(st, (dna[from >> 2] >> (6 - ((from & 3) << 1))) & 3); }
+  return to;
+}
+
+
+long int read_twobit(struct store *st, const unsigned char *map,
+                     long int length)
+{	/* load every record of a .2bit file, inserting n between them */
+	/* as FASTA; soft-masked bases are counted as lower case in FASTA */
+  const unsigned char *p, *rec, *starts, *sizes;
+  const char *title;
+  unsigned long v;
+  long int i, j, number, offset, dnasize, blocks, masks, from, start;
+  int swap, wide;
+
+  v = twobit_int(map, 4, 0);
+  swap = (v != TWOBIT_SIGNATURE);
+  v = twobit_int(map + 4, 4, swap);	/* version 1 has 64-bit offsets */
+  wide = (v == 1);
+  number = (long int)twobit_int(map + 8, 4, swap);
+  for (i = 0, p = map + 16, from = 0; piped == 0 && i < number; i++)
+  {	/* the size of the genome */
+    if (p + 1 > map + length ||
+        p + 1 + *p + ((wide != 0) ? 8 : 4) > map + length)
+    { break; }
+    offset = (long int)twobit_int(p + 1 + *p, (wide != 0) ? 8 : 4, swap);
+    p += 1 + *p + ((wide != 0) ? 8 : 4);
+    if (offset >= 0 && offset + 4 <= length)
+    { from += 1 + (long int)twobit_int(map + offset, 4, swap); }
+  }
+  reserve_genome(st->gnsize + from);
+  for (i = 0, p = map + 16; i < number; i++)
+  {
+    if (piped != 0 && rows >= size_data) { break; }	/* done */
+    if (p + 1 > map + length ||
+        p + 1 + *p + ((wide != 0) ? 8 : 4) > map + length)
+    { fprintf(stderr, "Error 17: broken .2bit index\n"); exit(EXIT_FAILURE); }
+    offset = (long int)twobit_int(p + 1 + *p, (wide != 0) ? 8 : 4, swap);
+    title = (const char *)p + 1;
+    p += 1 + *p + ((wide != 0) ? 8 : 4);
+    if (offset < 0 || offset + 8 > length)
+    { fprintf(stderr, "Error 17: broken .2bit record\n"); exit(EXIT_FAILURE); }
+    rec = map + offset;
+    dnasize = (long int)twobit_int(rec, 4, swap);
+    blocks  = (long int)twobit_int(rec + 4, 4, swap);
+    starts  = rec + 8;
+    sizes   = starts + 4 * blocks;
+    if (sizes + 4 * blocks + 4 > map + length)
+    { fprintf(stderr, "Error 17: broken .2bit record\n"); exit(EXIT_FAILURE); }
+    masks = (long int)twobit_int(sizes + 4 * blocks, 4, swap);
+    rec = sizes + 4 * blocks + 4 + 8 * masks + 4;	/* skip soft masks */
+    if (rec > map + length || (map + length - rec) < (dnasize + 3) / 4)
+    { fprintf(stderr, "Error 17: broken .2bit record\n"); exit(EXIT_FAILURE); }
+    put_gap(st, 1L);	/* insert n to split the two scaffolds */
+    put_record(st, title, title + (unsigned char)title[-1], 0L);
+    if (genome_full(st, dnasize) != 0) { break; }
+    for (j = 0, from = 0; j < blocks; j++)	/* runs of n */
+    {
+      start = (long int)twobit_int(starts + 4 * j, 4, swap);
+      if (start < from || start > dnasize) { continue; }	/* unsorted */
+      put_twobit(st, rec, from, start);
+      from = start + (long int)twobit_int(sizes + 4 * j, 4, swap);
+      if (from > dnasize) { from = dnasize; }
+      put_gap(st, from - start);
+    }
+    put_twobit(st, rec, from, dnasize);
+    st->gsize += dnasize;
+  }
+  return st->gnsize;
+}
+
+
+long int read_bed(const char *path, struct region **list)
+{	/* intervals of BED in the order of the file, except track, */
+	/* browser, and comment lines                                */
+  FILE *fp;
+  char *line = NULL, *name;
+  size_t size = 0;
+  long int number = 0, size_list = 0, start, end;
+  struct region *tmp;
+
+  if ((fp = fopen(path, "r")) == NULL)
+  { fprintf(stderr, "Error 26: cannot open %s\n", path); exit(EXIT_FAILURE); }
+  *list = NULL;
+  while (getline(&line, &size, fp) != -1)
+  {
+    if (line[0] == '#' || strncmp(line, "track", 5) == 0 ||
+        strncmp(line, "browser", 7) == 0)
+    { continue; }
+    if ((name = (char *)malloc(strlen(line) + 1)) == NULL)
+    { fprintf(stderr, "Error 26: malloc for BED\n"); exit(EXIT_FAILURE); }
+    if (sscanf(line, "%s %ld %ld", name, &start, &end) != 3)
+    {
+      free(name);
+      if (strspn(line, " \t\r\n") == strlen(line))
+      { continue; }	/* a blank line */
+      fprintf(stderr, "Error 26: not BED, %s", line);
+      exit(EXIT_FAILURE);
+    }
+    if (start < 0 || end < start)
+    {
+      fprintf(stderr, "Error 26: a wrong interval in BED, %s", line);
+      exit(EXIT_FAILURE);
+    }
+    if (number == size_list)
+    {
+      size_list = (size_list == 0) ? SIZE_GAPS : size_list * 2;
+      tmp = (struct region *)realloc(*list, sizeof(struct region) * size_list);
+      if (tmp == NULL)
+      { fprintf(stderr, "Error 26: realloc for BED\n"); exit(EXIT_FAILURE); }
+      *list = tmp;
+    }
+    (*list)[number].name  = name;
+    (*list)[number].start = start;
+    (*list)[number].end   = end;
+    number++;
+  }
+  free(line);
+  fclose(fp);
+  return number;
+}
+
+
+int compare_fai(const void *a, const void *b)
+{
+  return strcmp(((const struct fai *)a)->name, ((const struct fai *)b)->name);
+}
+
+
+long int read_fai(const char *path, struct fai **list)
+{	/* the sequences in the .fai index of a FASTA, sorted by name */
+  FILE *fp;
+  char *line = NULL, *name;
+  size_t size = 0;
+  long int number = 0, size_list = 0;
+  struct fai *tmp, f;
+
+  name = (char *)malloc(strlen(path) + strlen(FAI_SUFFIX) + 1);
+  if (name == NULL)
+  { fprintf(stderr, "Error 27: malloc for .fai\n"); exit(EXIT_FAILURE); }
+  sprintf(name, "%s%s", path, FAI_SUFFIX);
+  if ((fp = fopen(name, "r")) == NULL)
+  {
+    fprintf(stderr, "Error 27: cannot open %s for -b\n", name);
+    exit(EXIT_FAILURE);
+  }
+  free(name);
+  *list = NULL;
+  while (getline(&line, &size, fp) != -1)
+  {
+    if ((f.name = (char *)malloc(strlen(line) + 1)) == NULL)
+    { fprintf(stderr, "Error 27: malloc for .fai\n"); exit(EXIT_FAILURE); }
+    if (sscanf(line, "%s %ld %ld %ld %ld", f.name, &f.length, &f.offset,
+               &f.linebases, &f.linewidth) != 5 ||
+        f.length < 0 || f.offset < 0 || f.linebases < 1 ||
+        f.linewidth < f.linebases)
+    { fprintf(stderr, "Error 27: broken .fai, %s", line); exit(EXIT_FAILURE); }
+    if (number == size_list)
+    {
+      size_list = (size_list == 0) ? SIZE_GAPS : size_list * 2;
+      tmp = (struct fai *)realloc(*list, sizeof(struct fai) * size_list);
+      if (tmp == NULL)
+      { fprintf(stderr, "Error 27: realloc for .fai\n"); exit(EXIT_FAILURE); }
+      *list = tmp;
+    }
+    (*list)[number++] = f;
+  }
+  free(line);
+  fclose(fp);
+  qsort(*list, number, sizeof(struct fai), compare_fai);
+  return number;
+}
+
+
+long int inflate_range(struct bgzf *bz, z_stream *zs, long int from,
+                       long int to, char **buf, long int *size_buf)
+{	/* inflate the blocks which cover [from, to) of the uncompressed */
+	/* data into buf; the offset of from in buf is returned          */
+  long int lo = 0, hi = bz->num_blocks - 1, mid, k, filled = 0, got;
+  char *tmp;
+
+  while (lo < hi)	/* the last block starting at or before from */
+  {
+    mid = (lo + hi + 1) / 2;
+    if (bz->uoffset[mid] <= from) { lo = mid; } else { hi = mid - 1; }
+  }
+  for (k = lo; k < bz->num_blocks && bz->uoffset[k] < to; k++)
+  {
+    if (filled + SIZE_BGZF > *size_buf)
+    {
+      tmp = (char *)realloc(*buf, filled + SIZE_BGZF);
+      if (tmp == NULL)
+      { fprintf(stderr, "Error 15: realloc for BGZF\n"); exit(EXIT_FAILURE); }
+      *buf = tmp;
+      *size_buf = filled + SIZE_BGZF;
+    }
+    got = inflate_block(zs, bz->map + bz->coffset[k],
+                        bz->coffset[k + 1] - bz->coffset[k], *buf + filled);
+    if (got == -1)
+    { fprintf(stderr, "Error 22: broken BGZF block\n"); exit(EXIT_FAILURE); }
+    filled += got;
+  }
+  if (filled < to - bz->uoffset[lo])
+  {
+    fprintf(stderr, "Error 27: .fai does not match the FASTA\n");
+    exit(EXIT_FAILURE);
+  }
+  return from - bz->uoffset[lo];
+}
+
+
+long int read_regions(struct store *st, const char *path, const char *map,
+                      long int length)
+{	/* parse only the intervals of -b, finding them by .fai in FASTA, */
+	/* and by the blocks of BGZF if it is compressed                  */
+  struct fai *fai, *f, key;
+  struct bgzf bz;
+  z_stream zs;
+  char *buf = NULL;
+  const char *p;
+  long int i, number, from, to, start, end, size_buf = 0, used = 0;
+  int zipped = (bgzf_block_size((const unsigned char *)map, length) != 0);
+
+  if (zipped == 0 && length >= 2 &&
+      (unsigned char)map[0] == 0x1F && (unsigned char)map[1] == 0x8B)
+  {
+    fprintf(stderr, "Error 27: -b needs bgzip instead of gzip, %s\n", path);
+    exit(EXIT_FAILURE);
+  }
+  number = read_fai(path, &fai);
+  memset(&bz, 0, sizeof(bz));
+  memset(&zs, 0, sizeof(zs));
+  if (zipped != 0)
+  {
+    bz.map    = (const unsigned char *)map;
+    bz.length = length;
+    bgzf_index(&bz, path);
+    if (inflateInit2(&zs, -15) != Z_OK)
+    { fprintf(stderr, "Error 20: inflateInit2()\n"); exit(EXIT_FAILURE); }
+  }
+  fastq = 0;
+  for (i = 0; i < num_regions && used != -1; i++)
+  {
+    if (piped != 0 && rows >= size_data) { break; }	/* done */
+    key.name = regions[i].name;
+    f = (struct fai *)bsearch(&key, fai, number, sizeof(struct fai),
+                              compare_fai);
+    if (f == NULL)
+    {
+      fprintf(stderr, "Warning: %s is not in %s\n", regions[i].name, path);
+      continue;
+    }
+    start = (regions[i].start < f->length) ? regions[i].start : f->length;
+    end   = (regions[i].end < f->length) ? regions[i].end : f->length;
+    from = f->offset + start / f->linebases * f->linewidth +
+           start % f->linebases;
+    to   = f->offset + end / f->linebases * f->linewidth +
+           end % f->linebases;
+    put_gap(st, 1L);	/* insert n to split the two intervals */
+    put_record(st, f->name, f->name + strlen(f->name), start);
+    if (zipped != 0)
+    {
+      start = inflate_range(&bz, &zs, from, to, &buf, &size_buf);
+      p = buf + start;
+    }
+    else
+    {
+      if (to > length)
+      {
+        fprintf(stderr, "Error 27: .fai does not match %s\n", path);
+        exit(EXIT_FAILURE);
+      }
+      p = map + from;
+      madvise((char *)map + (from & ~4095L), to - (from & ~4095L),
+              MADV_WILLNEED);
+    }
+    used = parse_block(st, p, to - from, 1);
+  }
+  if (zipped != 0)
+  {
+    inflateEnd(&zs);
+    free(bz.coffset);
+    free(bz.uoffset);
+  }
+  for (i = 0; i < number; i++) { free(fai[i].name); }
+  free(fai);
+  free(buf);
+  return st->gnsize;
+}
+
+
+long int read_mapped(struct store *st, const char *path, int fd,
+                     long int length)
+{	/* parse the whole file directly in the mapping */
+  char *map;
+
+  map = (char *)mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (map == MAP_FAILED) { return -1L; }
+  if (num_regions > 0)	/* only pages around the intervals are read */
+  {
+    posix_fadvise(fd, 0, (off_t)length, POSIX_FADV_RANDOM);
+    madvise(map, length, MADV_RANDOM);
+    read_regions(st, path, map, length);
+    munmap(map, length);
+    return st->gnsize;
+  }
+  posix_fadvise(fd, 0, (off_t)length, POSIX_FADV_SEQUENTIAL);
+  madvise(map, length, MADV_SEQUENTIAL);
+  madvise(map, length, MADV_WILLNEED);	/* start readahead */
+  if (bgzf_block_size((unsigned char *)map, length) != 0)
+  { read_bgzf(st, path, (unsigned char *)map, length); }
+  else if (length >= 2 &&
+           (unsigned char)map[0] == 0x1F && (unsigned char)map[1] == 0x8B)
+  { read_gzip(st, NULL, (unsigned char *)map, length); }
+  else if (length >= 16 &&
+           (twobit_int((unsigned char *)map, 4, 0) == TWOBIT_SIGNATURE ||
+            twobit_int((unsigned char *)map, 4, 1) == TWOBIT_SIGNATURE))
+  { read_twobit(st, (unsigned char *)map, length); }
+  else
+  {
+    detect_format(map, length);
+    if (threads > 1 && piped == 0 && length > SIZE_BLOCK &&
+        (fastq == 0 || (fastq == 1 && fastq_wrapped(map, map + length) == 0)))
+    { read_parallel(st, map, length); }
+    else { parse_block(st, map, length, 1); }
+  }
+  munmap(map, length);
+  return st->gnsize;
+}
+
+
+int free_genome(void)
+{
+  if (cache_map != NULL) { munmap(cache_map, cache_length); }
+  else { free(gaps); put_pages(genome, size_packed); }
+  cache_map = NULL;
+  size_packed = 0;
+  gaps = NULL;
+  genome = NULL;
+  return 0;
+}
+
+
+unsigned long memory_checksum(unsigned long sum, const unsigned char *p,
+                              long int length)
+{	/* FNV-1a of eight bytes at a time */
+  unsigned long word;
+  long int i;
+
+  for (i = 0; i + 8 <= length; i += 8)
+  { memcpy(&word, p + i, 8); sum = (sum ^ word) * 1099511628211UL; }
+  for (; i < length; i++) { sum = (sum ^ p[i]) * 1099511628211UL; }
+  return sum;
+}
+
+
+unsigned long file_checksum(int fd, long int length)
+{
+  const unsigned char *map;
+  unsigned long sum = 14695981039346656037UL;
+
+  map = (const unsigned char *)mmap(NULL, length, PROT_READ, MAP_PRIVATE,
+                                    fd, 0);
+  if (map == MAP_FAILED) { return 0UL; }
+  madvise((void *)map, length, MADV_SEQUENTIAL);
+  sum = memory_checksum(sum, map, length);
+  munmap((void *)map, length);
+  return sum;
+}
+
+
+char *cache_name(const char *path)
+{	/* input.cog, to be freed */
+  char *name;
+
+  name = (char *)malloc(strlen(path) + strlen(CACHE_SUFFIX) + 24);
+  if (name == NULL)
+  {
+    fprintf(stderr, "Error 19: malloc for a cache name\n");
+    exit(EXIT_FAILURE);
+  }
+  sprintf(name, "%s%s", path, CACHE_SUFFIX);
+  return name;
+}
+
+
+int read_cache(const char *path, int fd, struct stat *sb)
+{	/* map the cache if it was made from the same file, else return 0 */
+  char *name, *map;
+  struct cache *hd;
+  struct stat cb;
+  int cfd;
+
+  name = cache_name(path);
+  cfd = open(name, O_RDONLY);
+  free(name);
+  if (cfd == -1) { return 0; }
+  if (fstat(cfd, &cb) != 0 || cb.st_size < (off_t)sizeof(struct cache))
+  { close(cfd); return 0; }
+  map = (char *)mmap(NULL, cb.st_size, PROT_READ, MAP_PRIVATE, cfd, 0);
+  close(cfd);
+  if (map == MAP_FAILED) { return 0; }
+  hd = (struct cache *)map;
+  if (memcmp(hd->magic, CACHE_MAGIC, 8) != 0 ||
+      hd->size != (long int)sb->st_size ||
+      (long int)cb.st_size != (long int)sizeof(struct cache) +
+        hd->num_gaps * (long int)sizeof(struct gap) + hd->gnsize / 4 + 16 ||
+      (hd->fastq >= 1 && hd->qscore != minimum_qscore) ||
+      (size_genome != 0 && size_genome - 1 < hd->gnsize) ||
+      ((hd->mtime != (long int)sb->st_mtim.tv_sec ||
+        hd->mtime_nsec != (long int)sb->st_mtim.tv_nsec) &&
+       hd->checksum != file_checksum(fd, (long int)sb->st_size)))
+  { munmap(map, cb.st_size); return 0; }	/* made from another file */
+  cache_map    = map;
+  cache_length = (long int)cb.st_size;
+  gsize        = hd->gsize;
+  gnsize       = hd->gnsize;
+  num_gaps     = hd->num_gaps;
+  fastq        = (short int)hd->fastq;
+  gaps   = (struct gap *)(map + sizeof(struct cache));
+  genome = (unsigned char *)(map + sizeof(struct cache) +
+                             sizeof(struct gap) * num_gaps);
+  return 1;
+}
+
+
+int write_cache(const char *path, int fd, struct stat *sb)
+{	/* write the genome into a temporary file and rename it */
+  char *name, *tmp;
+  struct cache hd;
+  FILE *fp;
+  int ok;
+
+  memset(&hd, 0, sizeof(hd));
+  memcpy(hd.magic, CACHE_MAGIC, 8);
+  hd.size       = (long int)sb->st_size;
+  hd.mtime      = (long int)sb->st_mtim.tv_sec;
+  hd.mtime_nsec = (long int)sb->st_mtim.tv_nsec;
+  hd.checksum   = file_checksum(fd, hd.size);
+  hd.gsize      = gsize;
+  hd.gnsize     = gnsize;
+  hd.num_gaps   = num_gaps;
+  hd.fastq      = fastq;
+  hd.qscore     = minimum_qscore;
+  name = cache_name(path);
+  tmp = cache_name(path);
+  sprintf(tmp, "%s%s.%ld", path, CACHE_SUFFIX, (long int)getpid());
+  fp = fopen(tmp, "wb");
+  ok = (fp != NULL &&
+        fwrite(&hd, sizeof(hd), 1, fp) == 1 &&
+        (num_gaps == 0 ||
+         fwrite(gaps, sizeof(struct gap), num_gaps, fp) == (size_t)num_gaps) &&
+        fwrite(genome, 1, gnsize / 4 + 16, fp) == (size_t)(gnsize / 4 + 16));
+  if (fp != NULL && fclose(fp) != 0) { ok = 0; }
+  if (ok == 0 || rename(tmp, name) != 0)
+  {
+    fprintf(stderr, "Warning: cannot write %s\n", name);
+    unlink(tmp);
+    ok = 0;
+  }
+  free(tmp);
+  free(name);
+  return ok;
+}
+
+
+int compare_record(const void *a, const void *b)
+{
+  const struct record *x = (const struct record *)a;
+  const struct record *y = (const struct record *)b;
+  int c = strcmp(x->name, y->name);
+
+  if (c != 0) { return c; }
+  return (x->start < y->start) ? -1 : (x->start > y->start);
+}
+
+
+int compare_gap(const void *a, const void *b)
+{
+  const struct gap *x = (const struct gap *)a, *y = (const struct gap *)b;
+
+  return (x->start < y->start) ? -1 : (x->start > y->start);
+}
+
+
+long int exclude_regions(struct store *st)
+{	/* turn the intervals of -x into gaps through the names of */
+	/* sequences and merge them into the sorted list, so that   */
+	/* counting skips them                                      */
+  struct record *r, key;
+  struct gap *extra = NULL, *tmp;
+  struct store merged;
+  long int i, j, k, lo, hi, mid, number = 0, size = 0, from, to;
+
+  for (i = 0; i < st->num_records; i++)	/* each ends at the next separator */
+  {
+    st->records[i].end = (i + 1 < st->num_records) ?
+                         st->records[i + 1].start - 1 : st->gnsize;
+  }
+  qsort(st->records, st->num_records, sizeof(struct record), compare_record);
+  for (i = 0; i < num_excludes; i++)
+  {
+    key.name = excludes[i].name;
+    for (lo = 0, hi = st->num_records; lo < hi; )	/* the first of it */
+    {
+      mid = (lo + hi) / 2;
+      if (strcmp(st->records[mid].name, key.name) < 0) { lo = mid + 1; }
+      else { hi = mid; }
+    }
+    for (r = st->records + lo; r < st->records + st->num_records &&
+         strcmp(r->name, key.name) == 0; r++)
+    {	/* the same name may appear in several inputs or intervals of -b */
+      from = excludes[i].start - r->offset + r->start;
+      to   = excludes[i].end - r->offset + r->start;
+      if (from < r->start) { from = r->start; }
+      if (to > r->end) { to = r->end; }
+      if (from >= to) { continue; }
+      if (number == size)
+      {
+        size = (size == 0) ? SIZE_GAPS : size * 2;
+        tmp = (struct gap *)realloc(extra, sizeof(struct gap) * size);
+        if (tmp == NULL)
+        { fprintf(stderr, "Error 9: realloc for -x\n"); exit(EXIT_FAILURE); }
+        extra = tmp;
+      }
+      extra[number].start = from;
+      extra[number].end   = to;
+      number++;
+    }
+  }
+  qsort(extra, number, sizeof(struct gap), compare_gap);
+  memset(&merged, 0, sizeof(merged));
+  for (i = j = 0; i < st->num_gaps || j < number; )	/* both are sorted */
+  {
+    if (j == number ||
+        (i < st->num_gaps && st->gaps[i].start < extra[j].start))
+    { from = st->gaps[i].start; to = st->gaps[i].end; i++; }
+    else { from = extra[j].start; to = extra[j].end; j++; }
+    k = merged.num_gaps - 1;
+    if (k >= 0 && merged.gaps[k].end >= from)	/* overlapping or adjacent */
+    { if (merged.gaps[k].end < to) { merged.gaps[k].end = to; } }
+    else { merged.gnsize = from; put_gap(&merged, to - from); }
+  }
+  free(st->gaps);
+  free(extra);
+  st->gaps     = merged.gaps;
+  st->num_gaps = merged.num_gaps;
+  for (i = 0; i < st->num_records; i++) { free(st->records[i].name); }
+  free(st->records);
+  st->records = NULL;
+  st->num_records = 0;
+  return number;
+}
+
+
+long int load_genome(char **paths, int number)
+{	/* join the inputs; mmap a regular file, or read it as a stream */
+  int fd = -1, k, i;
+  struct stat sb;
+  struct store st;
+  unsigned char *tmp;
+  FILE *fp = NULL;
+  const char *path = NULL;
+
+  memset(&st, 0, sizeof(st));
+  st.head = st.tail = -1;	/* no other threads */
+  sb.st_size = 0;
+  for (k = 0; k < number && st.full == 0 && (piped == 0 || rows < size_data);
+       k++)
+  {
+    if (fp != NULL) { fclose(fp); fp = NULL; }
+    else if (fd != -1) { close(fd); }
+    path = paths[k];
+    fd = (strcmp(path, "-") == 0) ? dup(STDIN_FILENO) : open(path, O_RDONLY);
+    if (fd == -1)
+    {
+      fprintf(stderr, "Error 13: cannot open %s\n", path);
+      exit(EXIT_FAILURE);
+    }
+    if (fstat(fd, &sb) == 0 && S_ISREG(sb.st_mode) && sb.st_size > 0)
+    {	/* a cache is kept only for a single named input */
+      if (cached != 0 && piped == 0 && number == 1 &&
+          strcmp(path, "-") != 0 && num_regions == 0 && num_excludes == 0 &&
+          read_cache(path, fd, &sb) != 0)
+      { close(fd); return gnsize; }
+    }
+    else { sb.st_size = 0; }	/* not a regular file */
+    if (num_regions > 0 && (sb.st_size == 0 || strcmp(path, "-") == 0))
+    {
+      fprintf(stderr, "Error 27: -b needs a regular file with .fai, %s\n",
+              path);
+      exit(EXIT_FAILURE);
+    }
+    fastq = -1;	/* each input may be in another format */
+    st.in_records = 0;
+    if (piped == 0)	/* a base takes at least a byte in FASTA and FASTQ */
+    {
+      reserve_genome(st.gnsize +
+                     ((num_regions > 0) ? size_regions + num_regions :
+                      (sb.st_size > 0) ? (long int)sb.st_size :
+                      SIZE_BLOCK * 4L));
+    }
+    if (sb.st_size > 0 &&
+        read_mapped(&st, path, fd, (long int)sb.st_size) != -1)
+    { continue; }
+    sb.st_size = 0;	/* no cache for streams */
+    fp = fdopen(fd, "r");
+    if (fp == NULL)
+    {
+      fprintf(stderr, "Error 13: cannot open %s\n", path);
+      exit(EXIT_FAILURE);
+    }
+    if ((i = getc(fp)) == 0x1F)
+    { ungetc(i, fp); read_gzip(&st, fp, NULL, 0L); }
+    else
+    {
+      if (i != EOF) { ungetc(i, fp); }
+      read_stream(&st, read_file, fp);
+    }
+  }
+  free(st.wrap);
+  if (num_excludes > 0) { exclude_regions(&st); }
+  gsize    = st.gsize;
+  gnsize   = st.gnsize;
+  gaps     = st.gaps;
+  num_gaps = st.num_gaps;
+  if (st.full != 0)
+  {
+    fprintf(stderr, "Warning: the genome is truncated at %ld (-g)\n", gnsize);
+  }
+  if (piped == 0 && gnsize / 4 + 16 < size_packed &&	/* return the rest */
+      (tmp = (unsigned char *)resize_pages(genome, size_packed,
+                                           gnsize / 4 + 16)) != NULL)
+  {
+    genome = tmp;
+    size_packed = gnsize / 4 + 16;
+  }
+  if (cached != 0 && piped == 0 && number == 1 && sb.st_size > 0 &&
+      st.full == 0 && strcmp(path, "-") != 0 && num_regions == 0 &&
+      num_excludes == 0)
+  { write_cache(path, fd, &sb); }
+  if (fp != NULL) { fclose(fp); } else { close(fd); }
+  return gnsize;
+}
+
+
+int reset_counter(void)
+{
+  unsigned int *cells[SKETCH_DEPTH];
+  long int i;
+  int r;
+
+  if (sketch.cells != NULL)	/* every nonzero cell was raised first by */
+  {	/* an oligo which is listed, so they are all cleared */
+    for (i = 0; i < sketch.listed; i++)
+    {
+      sketch_cells(table[i].code, cells);
+      for (r = 0; r < SKETCH_DEPTH; r++)
+      { if (*cells[r] != 0) { *cells[r] = 0; sketch.used++; } }
+    }
+    if (sketch.listed > 0) { sketch.cleared++; }
+    sketch.listed = 0;
+    return (int)i;
+  }
+  if (hashed != 0)
+  {
+    for (i = 0; i < size_hash; i++)
+    { table[i].code = NO_OLIGO; table[i].count = 0; }
+    return (int)i;
+  }
+  if (num_touched > size_counting)
+  { for (i = 0; i < size_oligo; i++) { counter[i] = 0; } }
+  else
+  for (i = 0; i < num_touched; i++) { counter[touched[i]] = 0; }
+  num_touched = 0;
+  return (int)i;
+}
+
+
+/* The oligo from position p is bits 2p to 2p+2k-1 of the genome read as */
+/* little-endian words, and k is a constant in each instance, so that the  */
+/* mask, the shifts and the loops are known to the compiler.  Each oligo  */
+/* is counted, with the first in a row touched, or buffered by put(), see */
+/* partition_codes().                                                      */
+#define OLIGOS(k, put) \
+  const unsigned long mask = (1UL << ((k) << 1)) - 1; \
+  unsigned long word; \
+  long int pos = from, last = from + number; \
+ \
+  for (; pos < last && (pos & 3) != 0; pos++)	/* up to a byte boundary */ \
+  { \
+    memcpy(&word, genome + (pos >> 2), sizeof(word)); \
+    put((word >> ((pos & 3) << 1)) & mask); \
+  } \
+  for (; last - pos >= 4; pos += 4)	/* four oligos from a word */ \
+  { \
+    memcpy(&word, genome + (pos >> 2), sizeof(word)); \
+    put(word & mask); \
+    put((word >> 2) & mask); \
+    put((word >> 4) & mask); \
+    put((word >> 6) & mask); \
+  } \
+  for (; pos < last; pos++) \
+  { \
+    memcpy(&word, genome + (pos >> 2), sizeof(word)); \
+    put((word >> ((pos & 3) << 1)) & mask); \
+  }
+#define PUT_COUNT(idx) if (counter[idx]++ == 0) { *t++ = (int)(idx); }
+#define PUT_CODE(idx) *q++ = (unsigned int)(idx)
+#define KERNELS(k) \
+long int count_##k(long int from, long int number) \
+{	/* count successive oligos from a position, which have no gaps */ \
+  int *t = touched + num_touched; \
+  OLIGOS(k, PUT_COUNT) \
+  num_touched = t - touched; \
+  return number; \
+} \
+ \
+long int buffer_##k(long int from, long int number) \
+{	/* the same oligos appended to codes */ \
+  unsigned int *q = codes + num_codes; \
+  OLIGOS(k, PUT_CODE) \
+  num_codes = q - codes; \
+  return number; \
+} \
+ \
+int complement_##k(int forward) \
+{	/* t <-> a, c <-> g in the reverse order */ \
+  unsigned int fwd = (unsigned int)forward, rev = 0; \
+  int i; \
+ \
+  for (i = 0; i < (k); i++) \
+  { rev = (rev << 2) | ((fwd & 3) ^ 2); fwd >>= 2; } \
+  return (int)rev; \
+} \
+ \
+char *spell_##k(int index, char *bases) \
+{	/* T, C, A, and G from the first base */ \
+  int i; \
+ \
+  for (i = 0; i < (k); i++) { bases[i] = "TCAG"[index & 3]; index >>= 2; } \
+  return bases + (k); \
+}
+#define KERNEL(k) { count_##k, buffer_##k, complement_##k, spell_##k }
+
+KERNELS(1)  KERNELS(2)  KERNELS(3)  KERNELS(4)  KERNELS(5)
+KERNELS(6)  KERNELS(7)  KERNELS(8)  KERNELS(9)  KERNELS(10)
+KERNELS(11) KERNELS(12) KERNELS(13) KERNELS(14) KERNELS(15)
+
+struct kernel kernels[MAX_OLIGO] =	/* kernels[k - 1] for -o k */
+{
+  KERNEL(1),  KERNEL(2),  KERNEL(3),  KERNEL(4),  KERNEL(5),
+  KERNEL(6),  KERNEL(7),  KERNEL(8),  KERNEL(9),  KERNEL(10),
+  KERNEL(11), KERNEL(12), KERNEL(13), KERNEL(14), KERNEL(15)
+};
+
+
+long int count_hashed(long int from, long int number)
+{	/* count successive oligos longer than MAX_OLIGO in the hash table */
+  int top = (oligo - 1) << 1;
+  unsigned long code = 0, rev = 0, base;
+  long int pos, first = from + oligo - 1, last = from + oligo - 1 + number;
+
+  for (pos = from; pos < last; pos++)	/* a shift and a base for each oligo */
+  {
+    base = (unsigned long)GET_BASE(pos);
+    code = (code >> 2) | (base << top);
+    rev = ((rev << 2) | (base ^ 2)) & oligo_mask;
+    if (pos >= first) { hash_oligo(code, rev); }
+  }
+  return number;
+}
+
+
+char *spell_code(unsigned long code, char *bases)
+{	/* T, C, A, and G of a code from the hash table */
+  int i;
+
+  for (i = 0; i < oligo; i++) { bases[i] = "TCAG"[code & 3]; code >>= 2; }
+  return bases + oligo;
+}
+
+
+int compare_hashed(const void *a, const void *b)
+{	/* in the order of the columns for shorter oligos */
+  unsigned long x = ((const struct hashed *)a)->code;
+  unsigned long y = ((const struct hashed *)b)->code;
+
+  return (x > y) - (x < y);
+}
+
+
+int print_header(void)
+{
+  char bases[MAX_OLIGO];
+  int j;
+
+  if (header == 0) { return (int)header; }
+  if (label !=0 ) { fprintf(stdout, "DATA\t"); }
+
+  for (j = 0; j < size_oligo; j++)
+  {
+    if (j > 0) { fputc('\t', stdout); }
+    fwrite(bases, 1, (size_t)(kernel.spell(j, bases) - bases), stdout);
+  }
+  fputc('\n', stdout);
+  return oligo;
+}
+
+
+long int partition_codes(void)
+{	/* count the codes of a row by partitions of the highest bits, so */
+	/* that the counters of each partition stay in the cache        */
+  static long int start[(1 << MAX_FANOUT) + 1];
+  long int i, n = num_codes;
+  int shift = (oligo << 1) - fanout;
+
+  memset(start, 0, sizeof(long int) * ((1 << fanout) + 1));
+  for (i = 0; i < n; i++) { start[(codes[i] >> shift) + 1]++; }
+  for (i = 1; i <= (1 << fanout); i++) { start[i] += start[i - 1]; }
+  for (i = 0; i < n; i++) { sorted[start[codes[i] >> shift]++] = codes[i]; }
+  for (i = 0; i < n; i++)
+  {
+    if (counter[sorted[i]]++ == 0) { touched[num_touched++] = (int)sorted[i]; }
+  }
+  num_codes = 0;
+  return n;
+}
+
+
+int increment_counter(int upto)
+{
+  int i = 0, counter_shift = 1;
+  long int valid, number;
+
+  while (i < upto)
+  {
+    valid = valid_run(gpos);
+    if (valid >= (long int)oligo)	/* count successive oligos at once */
+    {
+      number = valid - oligo + 1;
+      if (number > (long int)(upto - i)) { number = (long int)(upto - i); }
+      i += (int)kernel.count(gpos, number);
+      gpos += number;
+    }
+    else if (gpos + valid >= gnsize)	/* the end of the genome */
+    {
+      gpos = (long int)size_shift * counter_shift++;
+      if (gpos >= gnsize) { gpos = 0; counter_shift = 1; }
+      gpos++;
+    }
+    else { gpos = gaps[gap_cursor].end; }	/* skip a gap */
+    if (gsize >= (long int)size_shift * (counter_shift + 1))
+    { counter_shift = 0; }
+  }
+  if (fanout > 0) { partition_codes(); }	/* kernel.buffer() codes */
+  return i;
+}
+
+
+long int slide_window(void)
+{	/* put the codes from kernel.buffer() into the window, removing the */
+	/* oldest ones, with the maximum kept by the tally of each count  */
+  long int i;
+  int in, out;
+
+  for (i = 0; i < num_codes; i++)
+  {
+    if (ring_size == size_counting)	/* the oldest leaves */
+    {
+      out = ring[ring_head];
+      if (counter[out] == window_max && tally[counter[out]] == 1)
+      { window_max--; }
+      tally[counter[out]]--;
+      if (--counter[out] > 0) { tally[counter[out]]++; }
+      leaving[i] = out;
+    }
+    else { leaving[i] = -1; ring_size++; }
+    in = (int)codes[i];
+    ring[ring_head] = in;
+    if (counter[in] > 0) { tally[counter[in]]--; }
+    tally[++counter[in]]++;
+    if (counter[in] > window_max) { window_max = counter[in]; }
+    if (++ring_head == size_counting) { ring_head = 0; }
+  }
+  return i;
+}
+
+
+int reset_window(void)
+{	/* empty the window for another input */
+  long int i;
+
+  for (i = 0; i < ring_size; i++)
+  { counter[ring[i]] = 0; scaled[ring[i]] = 0; }
+  memset(tally, 0, sizeof(int) * (size_counting + 1));
+  window_max = scaled_max = 0;
+  ring_head = ring_size = num_codes = 0;
+  return (int)i;
+}
+
+
+long int find_runs(void)
+{	/* runs of oligos between the gaps, with the ordinal of the first */
+  long int r, start = 0, end;
+
+  runs = (struct run *)realloc(runs, sizeof(struct run) * (num_gaps + 2));
+  if (runs == NULL)
+  { fprintf(stderr, "Error 9: realloc for runs\n"); exit(EXIT_FAILURE); }
+  num_runs = num_oligos = 0;
+  for (r = 0; r <= num_gaps; r++)
+  {
+    end = (r < num_gaps) ? gaps[r].start : gnsize;
+    if (end - start >= (long int)oligo)
+    {
+      runs[num_runs].start = start;
+      runs[num_runs++].first = num_oligos;
+      num_oligos += end - start - oligo + 1;
+    }
+    if (r < num_gaps) { start = gaps[r].end; }
+  }
+  runs[num_runs].start = gnsize;	/* the sentinel */
+  runs[num_runs].first = num_oligos;
+  return num_oligos;
+}
 
-extern char *optarg;
-extern int optind;
 
-int *counter, *complementary;
-char *genome, *genomep;	/* genome and position */
+long int run_of_ordinal(long int o)
+{	/* the run of the o-th oligo */
+  long int lo = 0, hi = num_runs - 1, mid;
+
+  while (lo < hi)
+  {
+    mid = (lo + hi + 1) / 2;
+    if (runs[mid].first <= o) { lo = mid; } else { hi = mid - 1; }
+  }
+  return lo;
+}
 
-long int size_genome    = SIZE_GENOME,
-         gsize          = 0,	/* exclude inserted ns */
-         gnsize         = 0;	/* include inserted ns */
-int      size_oligo     = 1,
-         size_counting  = SIZE_COUNTING,
-         oligo          = OLIGO,
-         size_data      = SIZE_DATA,
-         size_shift     = SIZE_SHIFT,
-         minimum_qscore = DEFAULT_MIN_QSCORE;
-short int reduce = 0,	/* for complementary oligos */
-          header = 0,	/* print the header line */
-          label  = 0;	/* label for training data */
 
+long int oligo_ordinal(long int pos)
+{	/* the number of oligos which start before pos */
+  long int lo = 0, hi = num_runs, mid;
 
-int getopt(int, char * const [], const char *);
+  while (lo < hi)	/* the first run which starts after pos */
+  {
+    mid = (lo + hi) / 2;
+    if (runs[mid].start <= pos) { lo = mid + 1; } else { hi = mid; }
+  }
+  if (lo == 0) { return 0; }
+  lo--;
+  if (pos - runs[lo].start < runs[lo + 1].first - runs[lo].first)
+  { return runs[lo].first + pos - runs[lo].start; }
+  return runs[lo + 1].first;
+}
 
 
-int reset_counter(void)
+long int oligo_position(long int o)
 {
-  int i;
-  for (i = 0; i < size_oligo; i++) { counter[i] = 0; }
-  return i;
+  long int r = run_of_ordinal(o);
+
+  return runs[r].start + o - runs[r].first;
 }
 
 
-int print_header(void)
-{
-  int i, j, digit, fwd;
+unsigned long next_random(void)
+{	/* xorshift64* */
+  seed ^= seed >> 12;
+  seed ^= seed << 25;
+  seed ^= seed >> 27;
+  return seed * 2685821657736338717UL;
+}
 
-  if (header == 0) { return (int)header; }
-  if (label !=0 ) { fprintf(stdout, "DATA\t"); }
 
-  for (j = 0; j < size_oligo; j++)
+long int buffer_ordinals(long int o, long int number)
+{	/* kernel.buffer() for the oligos from the o-th, across the gaps */
+  long int r = run_of_ordinal(o), n, left = number;
+
+  for (; left > 0; r++, o += n, left -= n)
   {
-    if (j > 0) { fputc('\t', stdout); }
-    fwd = j;
-    for (i = 0; i < oligo; i++)
-    {
-      digit = fwd % NUCLEOTIDES;
-      fwd = (int)(fwd / NUCLEOTIDES);
-      if      (digit == 0) { fputc('T', stdout); }
-      else if (digit == 1) { fputc('C', stdout); }
-      else if (digit == 2) { fputc('A', stdout); }
-      else if (digit == 3) { fputc('G', stdout); }
-      else
+    n = runs[r + 1].first - o;
+    if (n > left) { n = left; }
+    kernel.buffer(runs[r].start + o - runs[r].first, n);
+  }
+  return number;
+}
+
+
+void *count_blocks(void *arg)
+{	/* count each block of oligos into the row of the next checkpoint */
+  struct blocks *bl = (struct blocks *)arg;
+  const unsigned long mask = oligo_mask;
+  unsigned long word;
+  long int j, r, o, n, left, pos, last;
+  unsigned int *row;
+
+  for (j = bl->from; j < bl->to; j++)
+  {
+    row = prefix + (j + 1) * size_oligo;
+    o = j * size_block;
+    for (r = run_of_ordinal(o), left = size_block; left > 0;
+         r++, o += n, left -= n)
+    {
+      n = runs[r + 1].first - o;
+      if (n > left) { n = left; }
+      pos = runs[r].start + o - runs[r].first;
+      for (last = pos + n; pos < last; pos++)
       {
-        fprintf(stderr, "Error 8: nucleotide %d\n", digit);
-        return EXIT_FAILURE;
+        memcpy(&word, genome + (pos >> 2), sizeof(word));
+        row[(word >> ((pos & 3) << 1)) & mask]++;
       }
     }
   }
-  fputc('\n', stdout);
-  return oligo;
+  return NULL;
 }
 
 
-int count_octamer(void)
-{	/* not necessarily restrict oligomer to octamer */
-  int i, n, octa = oligo, idx = 0, idc = 0;
+void *sum_blocks(void *arg)
+{	/* make the rows cumulative, for a range of columns */
+  struct blocks *bl = (struct blocks *)arg;
+  long int j, x;
+  unsigned int *row;
 
-  for (i = 0; i < octa; i++)
+  for (j = 1; j < num_checks; j++)
   {
-    switch (*(genomep + i))
-    {
-      case 't':  n = 0; break;
-      case 'c':  n = 1; break;
-      case 'a':  n = 2; break;
-      case 'g':  n = 3; break;
-      case '\0': return -1;
-      default:   return i;	/* i < octa */
-    }
-    idx += n * (int)pow((double)NUCLEOTIDES, (double)i);
+    row = prefix + j * size_oligo;
+    for (x = bl->from; x < bl->to; x++) { row[x] += row[x - size_oligo]; }
+  }
+  return NULL;
+}
+
+
+int run_blocks(void *(*work)(void *), long int number)
+{	/* split number of blocks or columns over the threads */
+  struct blocks *bl;
+  pthread_t *tid;
+  int i, n = (number < threads) ? (int)number : threads, *started;
+
+  if (n < 1) { return 0; }
+  bl = (struct blocks *)malloc(sizeof(struct blocks) * n);
+  tid = (pthread_t *)malloc(sizeof(pthread_t) * n);
+  started = (int *)calloc(n, sizeof(int));
+  if (bl == NULL || tid == NULL || started == NULL)
+  { fprintf(stderr, "Error 16: malloc for threads\n"); exit(EXIT_FAILURE); }
+  for (i = 0; i < n; i++)
+  {
+    bl[i].from = number * i / n;
+    bl[i].to = number * (i + 1) / n;
+  }
+  for (i = 1; i < n; i++)
+  { started[i] = (pthread_create(&tid[i], NULL, work, &bl[i]) == 0); }
+  work(&bl[0]);
+  for (i = 1; i < n; i++)
+  {
+    if (started[i] != 0) { pthread_join(tid[i], NULL); }
+    else                 { work(&bl[i]); }	/* no more threads */
+  }
+  free(started);
+  free(tid);
+  free(bl);
+  return n;
+}
+
+
+int load_index(const char *path)
+{	/* map the index if it was made for this genome, or make it */
+  struct index hd, *old;
+  struct stat sb;
+  char *tmp;
+  FILE *fp;
+  long int length;
+  int fd, ok;
+
+  memset(&hd, 0, sizeof(hd));
+  memcpy(hd.magic, INDEX_MAGIC, 8);
+  hd.checksum = memory_checksum(14695981039346656037UL, genome,
+                                (gnsize + 3) / 4);
+  hd.checksum = memory_checksum(hd.checksum, (const unsigned char *)gaps,
+                                (long int)sizeof(struct gap) * num_gaps);
+  hd.gnsize = gnsize;
+  hd.oligo = oligo;
+  hd.block = size_block;
+  hd.num_checks = num_checks = num_oligos / size_block + 1;
+  length = (long int)sizeof(struct index) +
+           (long int)sizeof(unsigned int) * size_oligo * num_checks;
+  if (length > SIZE_INDEX && length > gnsize)
+  {
+    fprintf(stderr, "Warning: the index %s takes %ld bytes for a genome "
+            "of %ld; -u may be raised\n", path, length, gnsize);
   }
-  counter[idx]++;
-  if (complementary[idx] == -1)	/* build the complementary table */
+  if ((fd = open(path, O_RDONLY)) != -1)
   {
-    for (i = 0; i < octa; i++)
+    if (fstat(fd, &sb) == 0 && (long int)sb.st_size == length &&
+        (index_map = (char *)mmap(NULL, length, PROT_READ, MAP_PRIVATE,
+                                  fd, 0)) != MAP_FAILED)
     {
-      switch (*(genomep + octa -1 - i))
+      old = (struct index *)index_map;
+      if (memcmp(old, &hd, sizeof(hd)) == 0)
       {
-        case 't':  n = 2; break;
-        case 'c':  n = 3; break;
-        case 'a':  n = 0; break;
-        case 'g':  n = 1; break;
-        default:   fprintf(stderr, "Error 3: complementary (%s)\n", genomep);
-                   return EXIT_FAILURE;
+        close(fd);
+        index_length = length;
+        prefix = (unsigned int *)(index_map + sizeof(struct index));
+        return 1;
       }
-      idc += n * (int)pow((double)NUCLEOTIDES, (double)i);
+      munmap(index_map, length);	/* for another genome */
     }
-    complementary[idx] = idc;
+    index_map = NULL;
+    close(fd);
+  }
+  prefix = (unsigned int *)get_pages((long int)sizeof(unsigned int) *
+                                     size_oligo * num_checks);
+  if (prefix == NULL)
+  {
+    fprintf(stderr, "Error 2: allocation of the index\n");
+    exit(EXIT_FAILURE);
+  }
+  run_blocks(count_blocks, num_checks - 1);
+  run_blocks(sum_blocks, size_oligo);
+  tmp = (char *)malloc(strlen(path) + 24);
+  if (tmp == NULL)
+  {
+    fprintf(stderr, "Error 19: malloc for an index name\n");
+    exit(EXIT_FAILURE);
+  }
+  sprintf(tmp, "%s.%ld", path, (long int)getpid());
+  fp = fopen(tmp, "wb");
+  ok = (fp != NULL && fwrite(&hd, sizeof(hd), 1, fp) == 1 &&
+        fwrite(prefix, sizeof(unsigned int) * size_oligo, num_checks, fp) ==
+        (size_t)num_checks);
+  if (fp != NULL && fclose(fp) != 0) { ok = 0; }
+  if (ok == 0 || rename(tmp, path) != 0)
+  {
+    fprintf(stderr, "Warning: cannot write %s\n", path);
+    unlink(tmp);
   }
-  return i;	/* i == octa */
+  free(tmp);
+  return 0;
 }
 
 
-int increment_counter(int upto)
+int free_index(void)
 {
-  int i = 0, rv, counter_shift = 1;
+  if (index_map != NULL) { munmap(index_map, index_length); }
+  else
+  {
+    put_pages(prefix,
+              (long int)sizeof(unsigned int) * size_oligo * num_checks);
+  }
+  index_map = NULL;
+  prefix = NULL;
+  return 0;
+}
+
+
+long int count_ordinals(long int o, long int number)
+{	/* the oligos from the o-th: those up to the first checkpoint and */
+	/* after the last one are buffered, and the blocks between them   */
+	/* are the difference of the two checkpoints                      */
+  long int first = (o + size_block - 1) / size_block;
+  long int last = (o + number) / size_block, x;
+  const unsigned int *lo, *hi;
+
+  if (prefix == NULL || last <= first) { return buffer_ordinals(o, number); }
+  buffer_ordinals(o, first * size_block - o);
+  buffer_ordinals(last * size_block, o + number - last * size_block);
+  lo = prefix + first * size_oligo;
+  hi = prefix + last * size_oligo;
+  for (x = 0; x < size_oligo; x++) { counter[x] += (int)(hi[x] - lo[x]); }
+  num_touched = size_counting + 1;	/* reset them all */
+  return number;
+}
+
+
+int index_counter(int upto)
+{	/* as increment_counter(), by the ordinals of oligos */
+  int i = 0, counter_shift = 1;
+  long int o, number, touched_all = 0;
 
   while (i < upto)
   {
-    rv = count_octamer();
-    if (rv == -1) { genomep = genome + size_shift * counter_shift++; }
-    else if (rv == oligo) { i++; }
-    if (gsize >= size_shift * (counter_shift + 1)) { counter_shift = 0; }
-    genomep++;
+    o = oligo_ordinal(gpos);	/* the first oligo from gpos */
+    if (o < num_oligos)
+    {
+      number = num_oligos - o;
+      if (number > (long int)(upto - i)) { number = (long int)(upto - i); }
+      count_ordinals(o, number);
+      if (num_touched > size_counting) { touched_all = 1; num_touched = 0; }
+      i += (int)number;
+      gpos = oligo_position(o + number - 1) + 1;
+    }
+    else	/* the end of the genome */
+    {
+      gpos = (long int)size_shift * counter_shift++;
+      if (gpos >= gnsize) { gpos = 0; counter_shift = 1; }
+      gpos++;
+    }
+    if (gsize >= (long int)size_shift * (counter_shift + 1))
+    { counter_shift = 0; }
+  }
+  if (fanout > 0) { partition_codes(); }	/* the codes at the edges */
+  else
+  {
+    for (o = 0; o < num_codes; o++)
+    {
+      if (counter[codes[o]]++ == 0) { touched[num_touched++] = (int)codes[o]; }
+    }
+    num_codes = 0;
   }
+  if (touched_all != 0) { num_touched = size_counting + 1; }
   return i;
 }
 
 
-int get_complementary_oligo(int forward)
+int round_unit(float f)
+{	/* f * 10000 rounded to the nearest, or to the even one on a tie, */
+	/* as printf() with %.4f; the product of a float is exact in double */
+  double d = (double)f * 10000.0, frac;
+  int r = (int)d;
+
+  frac = d - r;
+  if (frac > 0.5 || (frac == 0.5 && (r & 1) != 0)) { r++; }
+  return r;
+}
+
+
+int scale_scalar(const int *values, int number, int *units)
+{	/* the maximum, and values divided by it in units of 0.0001 */
+  int i, max = 0;
+
+  for (i = 0; i < number; i++) { if (values[i] > max) { max = values[i]; } }
+  if (max == 0) { return 0; }
+  for (i = 0; i < number; i++)
+  { units[i] = round_unit((float)values[i] / max); }
+  return max;
+}
+
+
+#ifdef X86_KERNELS
+#define ROUND_NEAREST (_MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC)
+
+TARGET("sse4.2") int scale_sse42(const int *values, int number, int *units)
+{	/* as scale_scalar(), rounding in double as ties to even */
+  __m128i m = _mm_setzero_si128();
+  __m128 f, fmax;
+  __m128d lo, hi;
+  const __m128d unit = _mm_set1_pd(10000.0);
+  int i, max = 0, lane[4];
+
+  for (i = 0; i + 4 <= number; i += 4)
+  { m = _mm_max_epi32(m, _mm_loadu_si128((const __m128i *)(values + i))); }
+  _mm_storeu_si128((__m128i *)lane, m);
+  for (; i < number; i++) { if (values[i] > max) { max = values[i]; } }
+  for (i = 0; i < 4; i++) { if (lane[i] > max) { max = lane[i]; } }
+  if (max == 0) { return 0; }
+  fmax = _mm_set1_ps((float)max);
+  for (i = 0; i + 4 <= number; i += 4)
+  {
+    f = _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)(values + i)));
+    f = _mm_div_ps(f, fmax);
+    lo = _mm_round_pd(_mm_mul_pd(_mm_cvtps_pd(f), unit), ROUND_NEAREST);
+    hi = _mm_round_pd(_mm_mul_pd(_mm_cvtps_pd(_mm_movehl_ps(f, f)), unit),
+                      ROUND_NEAREST);
+    _mm_storeu_si128((__m128i *)(units + i),
+                     _mm_unpacklo_epi64(_mm_cvtpd_epi32(lo),
+                                        _mm_cvtpd_epi32(hi)));
+  }
+  for (; i < number; i++) { units[i] = round_unit((float)values[i] / max); }
+  return max;
+}
+
+
+TARGET("avx2") int scale_avx2(const int *values, int number, int *units)
 {
-  int fwd = forward, rev = 0, i, n;
-  int *digits;
+  __m256i m = _mm256_setzero_si256();
+  __m256 f, fmax;
+  __m256d lo, hi;
+  const __m256d unit = _mm256_set1_pd(10000.0);
+  int i, max = 0, lane[8];
 
-  digits = (int *)malloc(sizeof(int) * oligo);
-  if (digits == NULL)
+  for (i = 0; i + 8 <= number; i += 8)
   {
-    fprintf(stderr, "Error 5: malloc for digits\n");
-    return EXIT_FAILURE;
+    m = _mm256_max_epi32(m, _mm256_loadu_si256((const __m256i *)(values + i)));
   }
-  for (i = 0; i < oligo; i++)
-  { digits[i] = fwd % NUCLEOTIDES; fwd = (int)(fwd / NUCLEOTIDES); }
-  for (i = oligo - 1; i > -1; i--)
+  _mm256_storeu_si256((__m256i *)lane, m);
+  for (; i < number; i++) { if (values[i] > max) { max = values[i]; } }
+  for (i = 0; i < 8; i++) { if (lane[i] > max) { max = lane[i]; } }
+  if (max == 0) { return 0; }
+  fmax = _mm256_set1_ps((float)max);
+  for (i = 0; i + 8 <= number; i += 8)
   {
-    if      (digits[i] == 0) { n = 2; }
-    else if (digits[i] == 1) { n = 3; }
-    else if (digits[i] == 2) { n = 0; }
-    else if (digits[i] == 3) { n = 1; }
-    else
-    {
-      fprintf(stderr, "Error 4: nucleotide %d\n", digits[i]);
-      free(digits);
-      return EXIT_FAILURE;
-    }
-    rev += n * (int)pow((double)NUCLEOTIDES, (double)(oligo - i - 1));
+    f = _mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i *)(values + i)));
+    f = _mm256_div_ps(f, fmax);
+    lo = _mm256_mul_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(f)), unit);
+    hi = _mm256_mul_pd(_mm256_cvtps_pd(_mm256_extractf128_ps(f, 1)), unit);
+    lo = _mm256_round_pd(lo, ROUND_NEAREST);
+    hi = _mm256_round_pd(hi, ROUND_NEAREST);
+    _mm256_storeu_si256((__m256i *)(units + i),
+      _mm256_insertf128_si256(_mm256_castsi128_si256(_mm256_cvtpd_epi32(lo)),
+                              _mm256_cvtpd_epi32(hi), 1));
   }
-  free(digits);
-  return rev;
+  for (; i < number; i++) { units[i] = round_unit((float)values[i] / max); }
+  return max;
 }
 
 
-int output_normalized_counts(char *tlabel)
+TARGET("avx512f") int scale_avx512(const int *values, int number, int *units)
+{
+  __m512i m = _mm512_setzero_si512();
+  __m512 f, fmax;
+  __m512d lo, hi;
+  const __m512d unit = _mm512_set1_pd(10000.0);
+  int i, max;
+
+  for (i = 0; i + 16 <= number; i += 16)
+  { m = _mm512_max_epi32(m, _mm512_loadu_si512((const void *)(values + i))); }
+  for (max = _mm512_reduce_max_epi32(m); i < number; i++)
+  { if (values[i] > max) { max = values[i]; } }
+  if (max == 0) { return 0; }
+  fmax = _mm512_set1_ps((float)max);
+  for (i = 0; i + 16 <= number; i += 16)
+  {
+    f = _mm512_cvtepi32_ps(_mm512_loadu_si512((const void *)(values + i)));
+    f = _mm512_div_ps(f, fmax);
+    lo = _mm512_mul_pd(_mm512_cvtps_pd(_mm512_castps512_ps256(f)), unit);
+    hi = _mm512_mul_pd(_mm512_cvtps_pd(_mm256_castpd_ps(
+           _mm512_extractf64x4_pd(_mm512_castps_pd(f), 1))), unit);
+    lo = _mm512_roundscale_pd(lo, ROUND_NEAREST);
+    hi = _mm512_roundscale_pd(hi, ROUND_NEAREST);
+    _mm256_storeu_si256((__m256i *)(units + i), _mm512_cvtpd_epi32(lo));
+    _mm256_storeu_si256((__m256i *)(units + i + 8), _mm512_cvtpd_epi32(hi));
+  }
+  for (; i < number; i++) { units[i] = round_unit((float)values[i] / max); }
+  return max;
+}
+#endif
+
+
+int (*scale_counts)(const int *, int, int *) = scale_scalar;
+
+
+char *put_unit(char *p, int r)
+{	/* 0 to 10000 from scale_counts() as %.4f */
+  p[0] = (char)('0' + r / 10000);
+  p[1] = '.';
+  p[2] = (char)('0' + r / 1000 % 10);
+  p[3] = (char)('0' + r / 100 % 10);
+  p[4] = (char)('0' + r / 10 % 10);
+  p[5] = (char)('0' + r % 10);
+  return p + SIZE_FIELD - 1;
+}
+
+
+int print_units(const int *units, int number)
+{	/* a row of %.4f from scale_counts(), written at once */
+  char *p = row;
+  int i;
+
+  for (i = 0; i < number; i++)
+  {
+    p = put_unit(p, units[i]);
+    *p++ = '\t';
+  }
+  if (number > 0) { fwrite(row, 1, (size_t)(p - row - 1), stdout); }
+  return number;
+}
+
+
+int print_hashed(void)
+{	/* the oligos found in the order of their codes, as TCAG...:0.1234 */
+  char field[MAX_LONG_OLIGO + SIZE_FIELD + 1], *p;
+  unsigned int *cells[SKETCH_DEPTH];
+  long int h, n = 0;
+
+  if (sketch.cells != NULL)	/* the estimates of the listed oligos */
+  for (n = sketch.listed, h = 0; h < n; h++)
+  { table[h].count = (int)sketch_cells(table[h].code, cells); }
+  else
+  for (h = 0; h < size_hash; h++)	/* gather them to the front */
+  { if (table[h].code != NO_OLIGO) { table[n++] = table[h]; } }
+  qsort(table, (size_t)n, sizeof(struct hashed), compare_hashed);
+  for (h = 0; h < n; h++) { counter[h] = table[h].count; }
+  scale_counts(counter, (int)n, scaled);
+  for (h = 0; h < n; h++)	/* the table is cleared by reset_counter() */
+  {
+    p = field;
+    if (h > 0) { *p++ = '\t'; }
+    p = spell_code(table[h].code, p);
+    *p++ = ':';
+    p = put_unit(p, scaled[h]);
+    fwrite(field, 1, (size_t)(p - field), stdout);
+  }
+  return (int)n;
+}
+
+
+int estimate_counts(void)
+{	/* every oligo from the sketch into counter, as if it were counted; */
+	/* with -r, a pair is in the smaller code and a palindrome twice   */
+  unsigned int *cells[SKETCH_DEPTH];
+  int i;
+
+  for (i = 0; i < size_oligo; i++)
+  {
+    if (reduce != 0 && complementary[i] == -1)
+      complementary[i] = kernel.complement(i);
+    if (reduce != 0 && complementary[i] < i) { counter[i] = 0; continue; }
+    counter[i] = (int)sketch_cells((unsigned long)i, cells);
+    if (reduce != 0 && complementary[i] == i)
+    { counter[i] >>= 1; }	/* doubled again when merged */
+  }
+  num_touched = size_counting + 1;	/* all of them are printed */
+  return size_oligo;
+}
+
+
+int print_counts(char *tlabel)
 {
   int i, j = 0, max = 0, *total;	/* j is a counter for output values */
 
-  reset_counter();
-  increment_counter(size_counting);
   if (label != 0) { fprintf(stdout, "%s\t", tlabel); }
 
-  if (reduce == 0)
+  if (sketch.cells != NULL && oligo <= MAX_OLIGO) { estimate_counts(); }
+  if (oligo > MAX_OLIGO) { j = print_hashed(); }
+  else if (reduce == 0 && slide > 0 && window_max > 0)
+  {	/* scaled is kept for the window, updated only where it changed */
+    max = window_max;
+    if ((max != scaled_max || num_codes * 2 > size_oligo) &&
+        size_oligo <= ring_size)
+    { scale_counts(counter, size_oligo, scaled); }	/* all of them again */
+    else if (max != scaled_max)
+    {
+      for (i = 0; i < ring_size; i++)
+      { scaled[ring[i]] = round_unit((float)counter[ring[i]] / max); }
+      for (i = 0; i < num_codes; i++)	/* those which left the window */
+      {
+        if (leaving[i] >= 0 && counter[leaving[i]] == 0)
+        { scaled[leaving[i]] = 0; }
+      }
+    }
+    else
+    for (i = 0; i < num_codes; i++)
+    {
+      scaled[codes[i]] = round_unit((float)counter[codes[i]] / max);
+      if (leaving[i] >= 0)
+      { scaled[leaving[i]] = round_unit((float)counter[leaving[i]] / max); }
+    }
+    scaled_max = max;
+    j = print_units(scaled, size_oligo);
+  }
+  else if (reduce == 0 && num_touched <= size_counting)
+  {	/* scaled is zero except for the touched in this mode */
+    for (i = 0; i < num_touched; i++)	/* search for maximum counts */
+    { if (counter[touched[i]] > max) { max = counter[touched[i]]; } }
+    if (max != 0)
+    {
+      for (i = 0; i < num_touched; i++)
+      { scaled[touched[i]] = round_unit((float)counter[touched[i]] / max); }
+      j = print_units(scaled, size_oligo);
+      for (i = 0; i < num_touched; i++) { scaled[touched[i]] = 0; }
+    }
+    else
+    for (i = 0; i < size_oligo; i++)	/* no oligos, as printf() does */
+    {
+      if (j++ != 0) { fputc('\t', stdout); }
+      fprintf(stdout, "%.4f", (float)counter[i] / max);
+    }
+  }
+  else if (reduce == 0)	/* not reset in the pipe mode beyond -t */
   {
-    for (i = 0; i < size_oligo; i++)	/* search for maximum counts */
-    { if (counter[i] > max) { max = counter[i]; } }
+    if ((max = scale_counts(counter, size_oligo, scaled)) != 0)
+    { j = print_units(scaled, size_oligo); }
+    else
     for (i = 0; i < size_oligo; i++)
     {
       if (j++ != 0) { fputc('\t', stdout); }
@@ -234,18 +3344,14 @@ int output_normalized_counts(char *tlabel)
     total = (int *)malloc(sizeof(int) * size_oligo);
     for (i = 0; i < size_oligo; i++)
     {
-      if (counter[i] != -1)	/* ignore complementary already processed */
-      {
-        if (complementary[i] == -1)
-          complementary[i] = get_complementary_oligo(i);
-        assert(counter[complementary[i]] != -1);
-        total[j++] = counter[i] + counter[complementary[i]];
-        /* ignore complementary in the next round */
-        counter[i] = counter[complementary[i]] = -1;      /* to ignore */
-      }
+      if (complementary[i] == -1)
+        complementary[i] = kernel.complement(i);
+      if (complementary[i] >= i)	/* the other one of a pair is later */
+      { total[j++] = counter[i] + counter[complementary[i]]; }
     }	/* j is the number of the total elements */
-    for (i = 0; i < j; i++)	/* search for one of the maximum counts */
-    { if (total[i] > max) { max = total[i]; } }
+    if ((max = scale_counts(total, j, scaled)) != 0)
+    { print_units(scaled, j); }
+    else
     for (i = 0; i < j; i++)
     {
       if (i != 0) { fputc('\t', stdout); }
@@ -258,30 +3364,142 @@ int output_normalized_counts(char *tlabel)
 }
 
 
+int output_normalized_counts(char *tlabel)
+{
+  int j;
+
+  if (slide > 0)	/* only the change from the last window */
+  {
+    increment_counter((ring_size == size_counting) ? slide : size_counting);
+    slide_window();
+    j = print_counts(tlabel);
+    num_codes = 0;	/* they were used for scaled */
+    return j;
+  }
+  reset_counter();
+  if (runs != NULL && seed != 0 && num_oligos > 0)	/* a random start */
+  {
+    gpos = oligo_position((long int)(next_random() %
+                                     (unsigned long)num_oligos));
+  }
+  if (runs != NULL) { index_counter(size_counting); }
+  else { increment_counter(size_counting); }
+  return print_counts(tlabel);
+}
+
+
+int select_kernels(const char *simd)
+{	/* the best kernels which the CPU supports, or those of -a */
+  static const char *names[] = { "scalar", "sse4.2", "avx2", "avx512" };
+  int level, best = 0;
+
+#ifdef X86_KERNELS
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("sse4.2")) { best = 1; }
+  if (__builtin_cpu_supports("avx2")) { best = 2; }
+  if (__builtin_cpu_supports("avx512f") &&
+      __builtin_cpu_supports("avx512bw") &&
+      __builtin_cpu_supports("avx512vl")) { best = 3; }
+#endif
+  level = best;
+  if (simd != NULL)
+  {
+    for (level = 0; level < 4 && strcmp(simd, names[level]) != 0; level++) {}
+    if (level == 4)
+    {
+      fprintf(stderr, "Warning: unknown SIMD %s, %s\n", simd, names[best]);
+      level = best;
+    }
+    else if (level > best)
+    {
+      fprintf(stderr, "Warning: no %s in the CPU, %s\n", simd, names[best]);
+      level = best;
+    }
+  }
+#ifdef X86_KERNELS
+  switch (level)	/* counting is in KERNELS() for the size of oligo */
+  {
+    case 3: encode_bases = encode_avx512; low_quality = quality_avx512;
+            scale_counts = scale_avx512;
+            break;
+    case 2: encode_bases = encode_avx2; low_quality = quality_avx2;
+            scale_counts = scale_avx2;
+            break;
+    case 1: encode_bases = encode_sse42; low_quality = quality_sse42;
+            scale_counts = scale_sse42;
+            break;
+  }
+#endif
+  return level;
+}
+
+
 int main(int argc, char* argv[])
 {
-  FILE *check;
-  char line[SIZE_LINE_CHARS], qscore[SIZE_LINE_CHARS], tlabel[SIZE_LINE_CHARS];
-  int num_chars;
-  int basepairs;
-  int i, opt, fastq = -1;
+  char tlabel[SIZE_LINE_CHARS], **labels, *bed = NULL, *excluded = NULL,
+       *simd = NULL, *indexed = NULL, *block = NULL;
+  int i, k, opt, num_labels = 0, shift;
+  long int j;
+  static struct option longopts[] =
+  {
+    {"regions", required_argument, NULL, 'b'},
+    {"exclude", required_argument, NULL, 'x'},
+    {"numa", required_argument, NULL, 'n'},
+    {"simd", required_argument, NULL, 'a'},
+    {"sketch", required_argument, NULL, 'm'},
+    {"slide", required_argument, NULL, 'w'},
+    {"index", required_argument, NULL, 'i'},
+    {"block", required_argument, NULL, 'u'},
+    {"random", required_argument, NULL, 'y'},
+    {NULL, 0, NULL, 0}
+  };
 
   assert(sizeof(int) >= 4);	/* int should be no less than 32 bit */
+  assert(sizeof(long int) >= 8);	/* SIZE_WORD bases in unsigned long */
 
-  while ((opt = getopt(argc, argv, "c:dg:l:o:q:rs:t:")) != -1)
+  labels = (char **)malloc(sizeof(char *) * argc);
+  if (labels == NULL)
+  { fprintf(stderr, "Error 23: malloc for labels\n"); return EXIT_FAILURE; }
+  while ((opt = getopt_long(argc, argv,
+                            "a:b:c:deg:i:j:kl:m:n:o:pq:rs:t:u:w:x:y:",
+                            longopts, NULL)) != -1)
   {
     switch (opt)
     {
+      case 'a': simd = optarg;	/* SIMD kernels */
+                break;
+      case 'b': bed = optarg;	/* only the intervals of BED */
+                break;
       case 'c': size_counting = atoi(optarg);
                 break;
       case 'd': header = 1;	/* print the header line */
                 break;
+      case 'e': each = 1;	/* count each input separately */
+                break;
       case 'g': size_genome = atol(optarg);
                 break;
+      case 'i': indexed = optarg;	/* counts at checkpoints */
+                break;
+      case 'j': threads = atoi(optarg);
+                break;
+      case 'k': cached = 1;	/* keep the genome in a cache file */
+                break;
       case 'l': strcpy(tlabel, optarg); label = 1;
+                labels[num_labels++] = optarg;	/* for each input with -e */
+                break;
+      case 'm': size_sketch = parse_size(optarg);	/* count-min sketch */
+                break;
+      case 'n': numa = (strcmp(optarg, "interleave") == 0) ? 2 : 1;
+                if (numa == 1 && strcmp(optarg, "local") != 0)
+                {
+                  fprintf(stderr, "Warning: unknown NUMA policy %s, local\n",
+                          optarg);
+                }
                 break;
       case 'o': oligo = atoi(optarg);
                 break;
+      case 'p': piped = 1;	/* count oligos while reading */
+                break;
       case 'q': minimum_qscore = atoi(optarg);
                 break;
       case 'r': reduce = 1;	/* merge complementary oligos */
@@ -290,109 +3508,224 @@ int main(int argc, char* argv[])
                 break;
       case 't': size_data = atoi(optarg);
                 break;
+      case 'u': block = optarg;	/* oligos between checkpoints */
+                break;
+      case 'w': slide = atoi(optarg);	/* the stride of windows */
+                break;
+      case 'x': excluded = optarg;	/* not counted in the intervals */
+                break;
+      case 'y': seed = strtoul(optarg, NULL, 10) * 2 + 1;	/* not zero */
+                break;
       default:  fprintf(stderr, "Warning: unknown option -%c\n", opt);
     }
   }
 
-  if (optind + 1 != argc)
+  if (optind >= argc)
   {
-    fprintf(stderr, "Error 1: specify an input FASTA file name\n");
+    fprintf(stderr, "Error 1: specify input file names, "
+            "or - for the standard input\n");
     return EXIT_FAILURE;
   }
-  else
-  {
-    check = fopen(argv[optind], "r");
-    if (check != NULL)
-    { fclose(check); check =freopen(argv[optind], "r", stdin); }
-  }
 
-  genome = (char *)malloc(size_genome);
-	/* char genome[size_genome]; does not work. */
-  if (genome == NULL)
+  if (oligo < 1 || oligo > MAX_LONG_OLIGO)
   {
-    fprintf(stderr, "Error 2: malloc(size_genome)\n");
+    fprintf(stderr, "Error 29: -o is 1 to %d\n", MAX_LONG_OLIGO);
     return EXIT_FAILURE;
   }
-  genomep = genome;
-
+  oligo_mask = (1UL << (oligo << 1)) - 1;
+  if (oligo > MAX_OLIGO || size_sketch > 0)	/* up to -c oligos in a row */
+  {
+    hashed = 1;
+    for (size_hash = 1; size_hash < 2L * size_counting; size_hash <<= 1)
+    { hash_shift--; }
+  }
+  if (oligo > MAX_OLIGO)	/* the counts and values to print */
+  {
+    size_oligo = (int)size_hash;
+    if (header != 0)
+    { fprintf(stderr, "Warning: no header with -o above %d\n", MAX_OLIGO); }
+    header = 0;
+  }
+  else	/* every oligo, estimated from the sketch with -m */
   for (i = 0; i < oligo; i++) { size_oligo *= NUCLEOTIDES; }
   	/* T, C, A, and G */
-  counter = (int *)malloc(sizeof(int) * size_oligo);
-  complementary = (int *)malloc(sizeof(int) * size_oligo);
-  for (i = 0; i < size_oligo; i++) { complementary[i] = -1; }
-
-  if (fgets(line, SIZE_LINE_CHARS, check) == NULL)
-	/* read the first line */
-  { fprintf(stderr, "Error 6: fgets()\n"); return EXIT_FAILURE; }
-  else
+  counter = (int *)get_pages(sizeof(int) * size_oligo);
+  scaled = (int *)get_pages(sizeof(int) * size_oligo);
+  if (hashed != 0)
+  { table = (struct hashed *)get_pages(sizeof(struct hashed) * size_hash); }
+  if (size_sketch > 0)	/* the widest power of two in the budget */
   {
-    if (line[0] == '>')      fastq = 0;
-    else if (line[0] == '@') fastq = 1;
-    else
+    for (sketch.width = 1, sketch.shift = 64;
+         (long int)sizeof(unsigned int) * SKETCH_DEPTH * sketch.width * 2 <=
+         size_sketch;
+         sketch.width <<= 1) { sketch.shift--; }
+    if (sketch.width < MIN_SKETCH)
+    {
+      fprintf(stderr, "Error 30: -m is less than %ld bytes\n",
+              (long int)sizeof(unsigned int) * SKETCH_DEPTH * MIN_SKETCH);
+      return EXIT_FAILURE;
+    }
+    sketch.cells = (unsigned int *)get_pages(sizeof(unsigned int) *
+                                             SKETCH_DEPTH * sketch.width);
+    if (sketch.cells == NULL)
     {
-      fprintf(stderr, "Error 7: neither FASTA nor FASTQ\n");
-      return EXIT_FAILURE; 
+      fprintf(stderr, "Error 2: allocation of the sketch\n");
+      return EXIT_FAILURE;
     }
   }
-
-  do	/* build the reference sequence using the genomep pointer */
+  if (oligo <= MAX_OLIGO)
   {
-    if (fastq == 1)	/* FASTQ */
+    complementary = (int *)get_pages(sizeof(int) * size_oligo);
+    row = (char *)malloc((size_t)size_oligo * SIZE_FIELD + 1);
+    touched = (int *)malloc(sizeof(int) * size_counting);
+  }
+  if (counter == NULL || scaled == NULL || (hashed != 0 && table == NULL) ||
+      (oligo <= MAX_OLIGO &&
+       (complementary == NULL || row == NULL || touched == NULL)))
+  {
+    fprintf(stderr, "Error 2: allocation of counters\n");
+    return EXIT_FAILURE;
+  }
+  for (i = 0; i < size_oligo && oligo <= MAX_OLIGO; i++)
+  { complementary[i] = -1; }
+  data_label = tlabel;
+  if (oligo <= MAX_OLIGO) { kernel = kernels[oligo - 1]; }	/* for -o */
+  if (hashed != 0) { kernel.count = count_hashed; }
+  if ((j = sysconf(_SC_LEVEL3_CACHE_SIZE)) <= 0 &&
+      (j = sysconf(_SC_LEVEL2_CACHE_SIZE)) <= 0)
+  { j = SIZE_CACHE; }
+  if (block != NULL && (size_block = atol(block)) < 1)
+  { fprintf(stderr, "Error 33: -u is at least 1\n"); return EXIT_FAILURE; }
+  if (block == NULL)	/* the index is about as large as the genome */
+  {
+    size_block = (INDEX_RATIO * size_oligo > INDEX_BLOCK) ?
+                 INDEX_RATIO * size_oligo : INDEX_BLOCK;
+  }
+  if ((indexed != NULL || seed != 0) &&
+      (hashed != 0 || piped != 0 || slide != 0))
+  {
+    fprintf(stderr, "Error 32: -i and -y are for -o up to %d "
+            "without -m, -p, or -w\n", MAX_OLIGO);
+    return EXIT_FAILURE;
+  }
+  if (slide != 0)	/* the codes from kernel.buffer() go to the window */
+  {
+    if (hashed != 0 || piped != 0 || slide < 0 || slide > size_counting)
     {
-      assert(line[0] == '@');
-      *genomep++ = 'n';	/* insert n to split the two scaffolds */
-      gnsize++;
-      if (fgets(line, SIZE_LINE_CHARS, check) == NULL)
-      { fprintf(stderr, "Error 10: fgets()\n"); return EXIT_FAILURE; }
-      if (fgets(qscore, SIZE_LINE_CHARS, check) == NULL)
-      { fprintf(stderr, "Error 11: fgets()\n"); return EXIT_FAILURE; }
-      if (fgets(qscore, SIZE_LINE_CHARS, check) == NULL)
-      { fprintf(stderr, "Error 12: fgets()\n"); return EXIT_FAILURE; }
-      basepairs = (int)strlen(line) - 1;
-      assert(basepairs == (int)strlen(qscore) - 1);
-      if (size_genome - 1 < gnsize + (long int)basepairs) break;
-      for (i = 0; i < basepairs; i++)
-      {
-        if ((int)qscore[i] + CODE_TO_SCORE < minimum_qscore)
-        { *genomep++ = 'n'; }
-        else if (line[i] == 'T') { *genomep++ = 't'; }
-        else if (line[i] == 'C') { *genomep++ = 'c'; }
-        else if (line[i] == 'A') { *genomep++ = 'a'; }
-        else if (line[i] == 'G') { *genomep++ = 'g'; }
-        else                     { *genomep++ = line[i]; }
-      }
-      gsize  += (long int)basepairs;
-      gnsize += (long int)basepairs;
+      fprintf(stderr, "Error 31: -w is 1 to -c, for -o up to %d "
+              "without -m or -p\n", MAX_OLIGO);
+      return EXIT_FAILURE;
     }
-    else	/* FASTA */
+    codes = (unsigned int *)malloc(sizeof(unsigned int) * size_counting);
+    ring = (int *)malloc(sizeof(int) * size_counting);
+    leaving = (int *)malloc(sizeof(int) * size_counting);
+    tally = (int *)calloc((size_t)size_counting + 1, sizeof(int));
+    if (codes == NULL || ring == NULL || leaving == NULL || tally == NULL)
     {
-      if (line[0] == '>') { *genomep++ = 'n'; gnsize++; continue; }
-	/* insert n to split the two scaffolds */
-      basepairs = num_chars = (int)strlen(line);
-      if (size_genome - 1 < gnsize + (long int)basepairs) break;
-      for (i = 0; i < num_chars; i++)
-      {
-        if (isalpha(line[i]) == 0) { basepairs--; }
-        else if (line[i] == 'T') { *genomep++ = 't'; }
-        else if (line[i] == 'C') { *genomep++ = 'c'; }
-        else if (line[i] == 'A') { *genomep++ = 'a'; }
-        else if (line[i] == 'G') { *genomep++ = 'g'; }
-        else                     { *genomep++ = line[i]; }
-      }
-      gsize  += (long int)basepairs;
-      gnsize += (long int)basepairs;
+      fprintf(stderr, "Error 2: allocation of the window\n");
+      return EXIT_FAILURE;
+    }
+    kernel.count = kernel.buffer;
+  }
+  else if (hashed == 0 && piped == 0 && (oligo << 1) > CACHE_BITS &&
+           (long int)sizeof(int) * size_oligo > j)	/* beyond the cache */
+  {	/* at least two partitions, or the direct kernel is kept */
+    fanout = ((oligo << 1) - CACHE_BITS < MAX_FANOUT) ?
+             (oligo << 1) - CACHE_BITS : MAX_FANOUT;
+    codes = (unsigned int *)malloc(sizeof(unsigned int) * size_counting);
+    sorted = (unsigned int *)malloc(sizeof(unsigned int) * size_counting);
+    if (codes == NULL || sorted == NULL)
+    {
+      fprintf(stderr, "Error 2: allocation of partitions\n");
+      return EXIT_FAILURE;
+    }
+    kernel.count = kernel.buffer;
+  }
+  else if (indexed != NULL || seed != 0)	/* oligos at edges of blocks */
+  {
+    codes = (unsigned int *)malloc(sizeof(unsigned int) * size_counting);
+    if (codes == NULL)
+    {
+      fprintf(stderr, "Error 2: allocation of the edges\n");
+      return EXIT_FAILURE;
+    }
+  }
+  select_kernels(simd);
+  if (threads < 1) { threads = (int)sysconf(_SC_NPROCESSORS_ONLN); }
+  if (each != 0) { label = 1; }	/* rows of each input are labelled */
+  if (bed != NULL)
+  {
+    num_regions = read_bed(bed, &regions);
+    for (j = 0; j < num_regions; j++)
+    { size_regions += regions[j].end - regions[j].start; }
+    if (num_regions == 0)
+    {
+      fprintf(stderr, "Error 26: no intervals in %s\n", bed);
+      return EXIT_FAILURE;
+    }
+  }
+  if (excluded != NULL)
+  {
+    if (piped != 0)
+    {
+      fprintf(stderr, "Error 28: -x needs the genome, not -p\n");
+      return EXIT_FAILURE;
     }
-  } while (fgets(line, SIZE_LINE_CHARS, check) != NULL);
-  *genomep = '\0';
+    num_excludes = read_bed(excluded, &excludes);
+  }
+  shift = size_shift;
 
-  genomep = genome;	/* reset */
-  if (gsize < (long int)size_shift) { size_shift = 1; }
   print_header();
-  for (i = 0; i < size_data; i++) output_normalized_counts(tlabel);
+  for (k = optind; k < argc; k++)	/* all at once unless -e */
+  {
+    if (each != 0)
+    {
+      data_label = (k - optind < num_labels) ? labels[k - optind] : argv[k];
+      rows = pipe_oligos = pipe_bases = 0;
+    }
+    if (piped != 0)	/* the genome is not kept */
+    {
+      reset_counter();
+      load_genome(argv + k, (each != 0) ? 1 : argc - k);
+    }
+    else
+    {
+      load_genome(argv + k, (each != 0) ? 1 : argc - k);
+      gpos = gap_cursor = 0;	/* reset */
+      if (slide != 0) { reset_window(); }
+      if (indexed != NULL || seed != 0) { find_runs(); }
+      if (indexed != NULL) { load_index(indexed); }
+      size_shift = (gsize < (long int)shift) ? 1 : shift;
+      for (i = 0; i < size_data; i++) output_normalized_counts(data_label);
+      if (indexed != NULL) { free_index(); }
+      free_genome();
+    }
+    if (each == 0) { break; }
+  }
+  if (numa != 0) { report_pages(); }
+  if (sketch.cells != NULL)	/* the last row too, which -p has reset */
+  {
+    if (piped == 0) { reset_counter(); }
+    report_sketch();
+  }
 
-  fclose(check);
-  free(complementary);
-  free(counter);
-  free(genome);
+  for (j = 0; j < num_regions; j++) { free(regions[j].name); }
+  for (j = 0; j < num_excludes; j++) { free(excludes[j].name); }
+  free(regions);
+  free(excludes);
+  free(labels);
+  if (hashed != 0) { put_pages(table, sizeof(struct hashed) * size_hash); }
+  put_pages(sketch.cells,
+            (long int)sizeof(unsigned int) * SKETCH_DEPTH * sketch.width);
+  free(row);
+  free(touched);
+  free(tally);
+  free(leaving);
+  free(ring);
+  free(sorted);
+  free(codes);
+  put_pages(scaled, sizeof(int) * size_oligo);
+  put_pages(complementary, sizeof(int) * size_oligo);
+  put_pages(counter, sizeof(int) * size_oligo);
   return EXIT_SUCCESS;
 }
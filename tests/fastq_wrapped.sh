@@ -0,0 +1,34 @@
+#!/bin/sh
+# A short single-line FASTQ read followed by long reads wrapped at 60
+# columns, whose quality lines may begin with @ and be followed by + two
+# lines below.  Rows must not depend on the number of threads (-j).
+#
+# usage: sh tests/fastq_wrapped.sh [countog]
+
+countog=${1:-./countog}
+dir=$(mktemp -d) || exit 1
+trap 'rm -rf "$dir"' 0
+
+awk 'BEGIN {
+  srand(5);
+  split("A C G T", base, " ");
+  split("@ + A B C D E F G H I J", qual, " ");
+  for (r = 0; r < 400; r++) {
+    n = (r == 0) ? 50 : 5000 + int(rand() * 15000);
+    s = ""; q = "";
+    for (i = 0; i < n; i++) {
+      s = s base[1 + int(rand() * 4)];
+      q = q qual[1 + int(rand() * 12)];
+    }
+    printf "@r%d\n", r;
+    if (r == 0) { printf "%s\n+\n%s\n", s, q; continue; }
+    for (i = 1; i <= n; i += 60) print substr(s, i, 60);
+    print "+";
+    for (i = 1; i <= n; i += 60) print substr(q, i, 60);
+  }
+}' > "$dir/wrap.fq"
+
+"$countog" -j 1 -o 4 -c 1000 -t 5 -q 0 "$dir/wrap.fq" > "$dir/1.out" || exit 1
+"$countog" -j 4 -o 4 -c 1000 -t 5 -q 0 "$dir/wrap.fq" > "$dir/4.out" || exit 1
+if cmp -s "$dir/1.out" "$dir/4.out"; then echo "PASS fastq_wrapped"
+else echo "FAIL fastq_wrapped: -j 4 differs from -j 1"; exit 1; fi
@@ -0,0 +1,32 @@
+#!/bin/sh
+# A genome of 4.9 Mb of A truncated by -g at about half of it.  Rows and
+# the warning must not depend on the number of threads (-j), the tail
+# must not read as T, and -k must not cache a truncated genome.
+#
+# usage: sh tests/genome_limit.sh [countog]
+
+countog=${1:-./countog}
+dir=$(mktemp -d) || exit 1
+trap 'rm -rf "$dir"' 0
+
+awk 'BEGIN {
+  s = "";
+  for (i = 0; i < 60; i++) s = s "A";
+  print ">a";
+  for (r = 0; r < 81700; r++) print s;
+}' > "$dir/a.fa"
+
+"$countog" -j 1 -o 1 -c 1000000 -t 3 -g 2500000 "$dir/a.fa" \
+  > "$dir/1.out" 2> "$dir/1.err" || exit 1
+"$countog" -j 4 -k -o 1 -c 1000000 -t 3 -g 2500000 "$dir/a.fa" \
+  > "$dir/4.out" 2> "$dir/4.err" || exit 1
+if ! cmp -s "$dir/1.out" "$dir/4.out"; then
+  echo "FAIL genome_limit: -j 4 differs from -j 1"; exit 1
+fi
+if ! grep -q truncated "$dir/4.err"; then
+  echo "FAIL genome_limit: no warning of truncation with -j 4"; exit 1
+fi
+if [ -e "$dir/a.fa.cog" ]; then
+  echo "FAIL genome_limit: -k cached a truncated genome"; exit 1
+fi
+echo "PASS genome_limit"